@@ -0,0 +1,125 @@
+#include "stdafx.h"
+#include "AffineMatrix3D.h"
+#include <xmmintrin.h>
+
+//--------------------------------------------------------------------------------------------------------------------//
+
+// Returns the combined transformation this * right, treating both as 4x4 matrices with a bottom row of (0, 0, 0, 1)
+AffineMatrix3D AffineMatrix3D::operator*(const AffineMatrix3D& right) const
+{
+	AffineMatrix3D result;
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		for (unsigned j = 0; j < 4; ++j)
+			result(i, j) = m_elements[i][0] * right(0, j) + m_elements[i][1] * right(1, j) + m_elements[i][2] * right(2, j);
+		result(i, 3) += m_elements[i][3];
+	}
+	return result;
+}
+
+//--------------------------------------------------------------------------------------------------------------------//
+
+// Transforms the points four at a time, with each matrix element broadcast across a register,
+// so that every lane works on a different point. The sums are done in the same order as operator*,
+// so the results match transforming the points one at a time.
+void AffineMatrix3D::transformPoints(const Vector3DArray& points, Vector3DArray& result) const
+{
+	result.resize(points.count);
+
+	__m128 m[3][4];
+	for (unsigned i = 0; i < 3; ++i)
+		for (unsigned j = 0; j < 4; ++j)
+			m[i][j] = _mm_set1_ps(m_elements[i][j]);
+
+	const unsigned padded = static_cast<unsigned>(points.x.size());
+	for (unsigned k = 0; k < padded; k += 4)
+	{
+		const __m128 x = _mm_load_ps(&points.x[k]), y = _mm_load_ps(&points.y[k]), z = _mm_load_ps(&points.z[k]);
+		_mm_store_ps(&result.x[k], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0], x), _mm_mul_ps(m[0][1], y)), _mm_mul_ps(m[0][2], z)), m[0][3]));
+		_mm_store_ps(&result.y[k], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1][0], x), _mm_mul_ps(m[1][1], y)), _mm_mul_ps(m[1][2], z)), m[1][3]));
+		_mm_store_ps(&result.z[k], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2][0], x), _mm_mul_ps(m[2][1], y)), _mm_mul_ps(m[2][2], z)), m[2][3]));
+	}
+}
+
+// The same as transformPoints(), but without the translation
+void AffineMatrix3D::transformVectors(const Vector3DArray& vectors, Vector3DArray& result) const
+{
+	result.resize(vectors.count);
+
+	__m128 m[3][3];
+	for (unsigned i = 0; i < 3; ++i)
+		for (unsigned j = 0; j < 3; ++j)
+			m[i][j] = _mm_set1_ps(m_elements[i][j]);
+
+	const unsigned padded = static_cast<unsigned>(vectors.x.size());
+	for (unsigned k = 0; k < padded; k += 4)
+	{
+		const __m128 x = _mm_load_ps(&vectors.x[k]), y = _mm_load_ps(&vectors.y[k]), z = _mm_load_ps(&vectors.z[k]);
+		_mm_store_ps(&result.x[k], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0], x), _mm_mul_ps(m[0][1], y)), _mm_mul_ps(m[0][2], z)));
+		_mm_store_ps(&result.y[k], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1][0], x), _mm_mul_ps(m[1][1], y)), _mm_mul_ps(m[1][2], z)));
+		_mm_store_ps(&result.z[k], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2][0], x), _mm_mul_ps(m[2][1], y)), _mm_mul_ps(m[2][2], z)));
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------------//
+
+// Returns the inverse of this transformation matrix, such that this * this->inverseTransform() gives the identity matrix.
+// The 3x3 part is inverted with its cofactors, so this works for any invertible affine matrix, not just rotations.
+AffineMatrix3D AffineMatrix3D::inverseTransform() const
+{
+	const float (&m)[3][4] = m_elements;
+	AffineMatrix3D inverse;
+
+	// Transposed cofactors of the 3x3 part
+	inverse(0, 0) = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	inverse(0, 1) = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+	inverse(0, 2) = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+	inverse(1, 0) = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	inverse(1, 1) = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+	inverse(1, 2) = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+	inverse(2, 0) = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	inverse(2, 1) = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+	inverse(2, 2) = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+
+	const float invDeterminant = 1.0f / (m[0][0] * inverse(0, 0) + m[0][1] * inverse(1, 0) + m[0][2] * inverse(2, 0));
+	for (unsigned i = 0; i < 3; ++i)
+		for (unsigned j = 0; j < 3; ++j)
+			inverse(i, j) *= invDeterminant;
+
+	// The inverse translation takes the translation back through the inverted 3x3 part
+	for (unsigned i = 0; i < 3; ++i)
+		inverse(i, 3) = -(inverse(i, 0) * m[0][3] + inverse(i, 1) * m[1][3] + inverse(i, 2) * m[2][3]);
+
+	return inverse;
+}
+
+//--------------------------------------------------------------------------------------------------------------------//
+
+// Builds the matrix Rx * Ry * Rz * TS in one go, without forming the separate rotation matrices.
+// TS scales by the given amounts along each axis and then translates, so the translation is rotated too.
+// Params:
+//	rotation		sines and cosines of the Euler rotation angles
+//	translation		translation applied before the rotation
+//	scale			scaling along each axis, applied before the rotation
+AffineMatrix3D AffineMatrix3D::fromEulerRotation(const EulerSinCos& rotation, const Point3D& translation, const Vector3D& scale)
+{
+	const float sx = rotation.sinX, cx = rotation.cosX,
+		sy = rotation.sinY, cy = rotation.cosY,
+		sz = rotation.sinZ, cz = rotation.cosZ;
+
+	// Rx = [1, 0, 0; 0, cx, -sx; 0, sx, cx], Ry = [cy, 0, sy; 0, 1, 0; -sy, 0, cy], Rz = [cz, sz, 0; -sz, cz, 0; 0, 0, 1]
+	const float r[3][3] = {
+		{ cy * cz,						cy * sz,						sy },
+		{ sx * sy * cz - cx * sz,		sx * sy * sz + cx * cz,			-sx * cy },
+		{ -cx * sy * cz - sx * sz,		-cx * sy * sz + sx * cz,		cx * cy } };
+
+	AffineMatrix3D result;
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		result(i, 0) = r[i][0] * scale.x;
+		result(i, 1) = r[i][1] * scale.y;
+		result(i, 2) = r[i][2] * scale.z;
+		result(i, 3) = r[i][0] * translation.x + r[i][1] * translation.y + r[i][2] * translation.z;
+	}
+	return result;
+}
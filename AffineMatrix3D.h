@@ -0,0 +1,111 @@
+#pragma once
+#include "Point3D.h"
+#include "Vector3DArray.h"
+
+// Sines and cosines of a set of Euler angles (in radians), worked out once so that
+// every matrix built from the same angles can share them
+struct EulerSinCos
+{
+	float sinX, cosX, sinY, cosY, sinZ, cosZ;
+
+	explicit EulerSinCos(const Vector3D& angles)
+	{
+		sinCos(angles.x, sinX, cosX);
+		sinCos(angles.y, sinY, cosY);
+		sinCos(angles.z, sinZ, cosZ);
+	}
+
+	// Find the sine and cosine of the same angle together. The angle is reduced once to within
+	// pi/4 of a multiple of pi/2, and both are evaluated there with short polynomials, whose
+	// errors are far below float precision; the quadrant then picks which is which and the signs.
+	static void sinCos(float angle, float& s, float& c)
+	{
+		const double c_twoOverPi = 0.63661977236758134308;
+		const double c_halfPiHigh = 1.5707963267341256, c_halfPiLow = 6.077100506506192e-11;	// pi/2 split so quadrant * high is exact
+
+		const double quadrant = floor(angle * c_twoOverPi + 0.5);
+		const double r = (angle - quadrant * c_halfPiHigh) - quadrant * c_halfPiLow;
+		const double r2 = r * r;
+		const double sinR = r * (1.0 + r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 + r2 * (1.0 / 362880 + r2 * (-1.0 / 39916800))))));
+		const double cosR = 1.0 + r2 * (-0.5 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800 + r2 * (1.0 / 479001600))))));
+
+		switch (static_cast<long long>(quadrant) & 3)
+		{
+		case 0: s = static_cast<float>(sinR); c = static_cast<float>(cosR); break;
+		case 1: s = static_cast<float>(cosR); c = static_cast<float>(-sinR); break;
+		case 2: s = static_cast<float>(-sinR); c = static_cast<float>(-cosR); break;
+		default: s = static_cast<float>(-cosR); c = static_cast<float>(sinR); break;
+		}
+	}
+};
+
+// A class for 3D affine transformations, stored as the top three rows of a homogeneous matrix.
+// The bottom row is always (0, 0, 0, 1), so it is left out, along with all the arithmetic on it.
+class AffineMatrix3D
+{
+public:
+	// Const accessor for individual components (rows 0 to 2).
+	const float& operator()(unsigned i, unsigned j) const
+	{
+		return m_elements[i][j];
+	}
+
+	// Writable accessor for individual components (rows 0 to 2).
+	float& operator()(unsigned i, unsigned j)
+	{
+		return m_elements[i][j];
+	}
+
+	// Apply this matrix to a vector (the translation doesn't affect it)
+	Vector3D operator*(const Vector3D& vec) const
+	{
+		return Vector3D(
+			m_elements[0][0] * vec.x + m_elements[0][1] * vec.y + m_elements[0][2] * vec.z,
+			m_elements[1][0] * vec.x + m_elements[1][1] * vec.y + m_elements[1][2] * vec.z,
+			m_elements[2][0] * vec.x + m_elements[2][1] * vec.y + m_elements[2][2] * vec.z);
+	}
+
+	// Apply this matrix to a point
+	Point3D operator*(const Point3D& pt) const
+	{
+		return Point3D(
+			m_elements[0][0] * pt.x + m_elements[0][1] * pt.y + m_elements[0][2] * pt.z + m_elements[0][3],
+			m_elements[1][0] * pt.x + m_elements[1][1] * pt.y + m_elements[1][2] * pt.z + m_elements[1][3],
+			m_elements[2][0] * pt.x + m_elements[2][1] * pt.y + m_elements[2][2] * pt.z + m_elements[2][3]);
+	}
+
+	AffineMatrix3D operator*(const AffineMatrix3D& right) const;
+
+	// Apply this matrix to every point or vector in an array, four at a time.
+	// The output may be the same array as the input.
+	void transformPoints(const Vector3DArray& points, Vector3DArray& result) const;
+	void transformVectors(const Vector3DArray& vectors, Vector3DArray& result) const;
+
+	AffineMatrix3D inverseTransform() const;
+
+	static AffineMatrix3D fromEulerRotation(const EulerSinCos& rotation, const Point3D& translation, const Vector3D& scale);
+
+private:
+	// The top three rows of the matrix stored in a 2D array
+	float	m_elements[3][4] = {	{ 1.0f, 0.0f, 0.0f, 0.0f },
+							{ 0.0f, 1.0f, 0.0f, 0.0f },
+							{ 0.0f, 0.0f, 1.0f, 0.0f } };
+};
+
+// An affine transformation together with its inverse, which is only recalculated when the transformation is set
+class AffineTransform
+{
+public:
+	void set(const AffineMatrix3D& matrix)
+	{
+		m_matrix = matrix;
+		m_inverse = matrix.inverseTransform();
+	}
+
+	const AffineMatrix3D& matrix() const { return m_matrix; }
+	const AffineMatrix3D& inverse() const { return m_inverse; }
+
+private:
+	AffineMatrix3D m_matrix;
+	AffineMatrix3D m_inverse;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <malloc.h>
+#include <new>
+#include <vector>
+
+// Allocator for std::vector that aligns its storage to the given number of bytes,
+// so that arrays can be read with aligned SIMD loads.
+template <typename T, std::size_t Alignment = 32>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(std::size_t n)
+	{
+		void* ptr = _aligned_malloc(n * sizeof(T), Alignment);
+		if (ptr == nullptr)
+			throw std::bad_alloc();
+		return static_cast<T*>(ptr);
+	}
+
+	void deallocate(T* ptr, std::size_t)
+	{
+		_aligned_free(ptr);
+	}
+};
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return true; }
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return false; }
+
+// Shorthand for a vector of floats aligned for SIMD loads
+typedef std::vector<float, AlignedAllocator<float> > AlignedFloatArray;
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "Application.h"
 #include "Object.h"
+#include "Benchmark.h"
 
 // Constructor -- initialise application-specific data here
 Application::Application()
@@ -9,7 +10,7 @@ Application::Application()
 
 Application::~Application()
 {
-	for (auto obj : m_objects)
+	for (auto obj : m_scene.objects)
 	{
 		if (obj != nullptr)
 			delete obj;
@@ -26,30 +27,86 @@ bool Application::run()
 
 	setupScene();
 
+	// The worker threads last until the application quits, so no frame has to start any
+	m_threadPool.start();
+
 	// Main loop
 	m_quit = false;
+	m_pathFrame = 0;
+	m_pathStartTime = SDL_GetPerformanceCounter();
+	m_presentTime = SDL_GetPerformanceCounter();
+	m_frameRateStart = m_presentTime;
 	while (!m_quit)
 	{
-		// Process events
-		SDL_Event ev;
-		while (SDL_PollEvent(&ev))
+		if (m_pipelineRequested != m_pipelined)
+			setPipelined(m_pipelineRequested);
+		if (m_vsyncRequested != m_vsync && !setVsync(m_vsyncRequested))
+			break;
+
+		if (m_pipelined)
 		{
-			processEvent(ev);
+			// The render thread samples the input and renders, so just pass the events on and
+			// present each frame as soon as it is ready
+			forwardInput();
+			RenderedFrame& frame = m_frames[m_presentFrame];
+			if (frame.state.load(std::memory_order_acquire) != RenderedFrame::Ready)
+			{
+				// Sleep until the frame is ready, waking now and then to pass on new input
+				std::unique_lock<std::mutex> lock(m_frameStateMutex);
+				m_frameStateChanged.wait_for(lock, c_inputForwardInterval,
+					[&] { return frame.state.load(std::memory_order_acquire) == RenderedFrame::Ready || m_quit; });
+				continue;
+			}
+			present(frame);
+			m_presentFrame ^= 1;
 		}
+		else
+		{
+			// Process events as late as possible, so the frame shows the newest input, then
+			// render and present the frame
+			RenderedFrame& frame = m_frames[0];
+			waitForInputDeadline();
+			sampleInput(frame);
+			renderFrame(frame);
+			if (m_quit)
+				break;
+			present(frame);
+		}
+		updateWindowTitle();
+	}
+	setPipelined(false);
+	m_threadPool.stop();
 
-		// Update objects' positions
-		update();
+	reportFrameRates();
+	if (m_latencyFrames > 0)
+		std::cout << "Average input to present latency: " << m_totalSampleLatency / m_latencyFrames << " ms over " << m_latencyFrames << " frames" << std::endl;
 
-		// Render
-		render();
-		SDL_RenderPresent(m_renderer);
-	}
+	if (m_pathMode == PathMode::Record && !m_cameraPath.save(m_pathFilename.c_str()))
+		std::cout << "Couldn't save the camera path to " << m_pathFilename << std::endl;
+	else if (m_pathMode == PathMode::Replay || m_pathMode == PathMode::ReplayFast)
+		reportReplay();
 
 	// Shutdown
 	shutdownSDL();
 	return true;
 }
 
+bool Application::setPathMode(PathMode mode, const char* filename)
+{
+	m_pathMode = mode;
+	m_pathFilename = filename;
+	m_cameraPath.clear();
+	if (mode == PathMode::Replay || mode == PathMode::ReplayFast)
+	{
+		if (!m_cameraPath.load(filename))
+		{
+			std::cout << "Couldn't load the camera path from " << filename << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 // Initialise the required parts of the SDL library
 // Return true if initialisation is successful, or false if initialisation fails
 bool Application::initSDL()
@@ -67,19 +124,75 @@ bool Application::initSDL()
 		return false;
 	}
 
-	m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	// Input is sampled relative to the display's vsync, so it needs the refresh rate
+	SDL_DisplayMode displayMode;
+	if (SDL_GetWindowDisplayMode(m_window, &displayMode) == 0 && displayMode.refresh_rate > 0)
+		m_refreshPeriod = 1000.0 / displayMode.refresh_rate;
+
+	return createRenderer();
+}
+
+// Create the renderer, with or without vsync, and the screen texture that belongs to it
+// Return true if creation is successful, or false if it fails
+bool Application::createRenderer()
+{
+	// SDL 2.0.10 can't switch vsync on an existing renderer, so the old one is replaced
+	if (m_texture)
+	{
+		SDL_DestroyTexture(m_texture);
+		m_texture = nullptr;
+	}
+	if (m_renderer)
+	{
+		SDL_DestroyRenderer(m_renderer);
+		m_renderer = nullptr;
+	}
+
+	m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED | (m_vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
 	if (m_renderer == nullptr)
 	{
 		std::cout << "SDL_CreateRenderer Error: " << SDL_GetError() << std::endl;
 		return false;
 	}
 
+	// The Colour struct is laid out as r, g, b, a bytes, which matches SDL_PIXELFORMAT_RGBA32
+	m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+		m_camera.getViewPlaneResolutionX(), m_camera.getViewPlaneResolutionY());
+	if (m_texture == nullptr)
+	{
+		std::cout << "SDL_CreateTexture Error: " << SDL_GetError() << std::endl;
+		return false;
+	}
+
 	return true;
 }
 
+// Switch vsync on or off between frames
+// Return false if the new renderer can't be created
+bool Application::setVsync(bool vsync)
+{
+	m_vsync = vsync;
+	m_frameRateStart = SDL_GetPerformanceCounter();
+	m_frameRateFrames = 0;
+	return createRenderer();
+}
+
+void Application::setFrameRateLimit(unsigned framesPerSecond)
+{
+	m_frameLimiter.setFrameRate(framesPerSecond);
+	m_frameRateStart = SDL_GetPerformanceCounter();
+	m_frameRateFrames = 0;
+}
+
 // Shutdown the SDL library
 void Application::shutdownSDL()
 {
+	if (m_texture)
+	{
+		SDL_DestroyTexture(m_texture);
+		m_texture = nullptr;
+	}
+
 	if (m_renderer)
 	{
 		SDL_DestroyRenderer(m_renderer);
@@ -95,21 +208,45 @@ void Application::shutdownSDL()
 	SDL_Quit();
 }
 
-// Process a single event
+// Process an event that changes how frames are presented, which is always done on the main thread
+// Return true if the event was handled, or false if it should be passed on to processEvent()
+bool Application::processPresentEvent(const SDL_Event &ev)
+{
+	if (ev.type == SDL_QUIT || (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_ESCAPE))
+		m_quit = true;
+	else if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_l)
+		m_lateInput = !m_lateInput;
+	else if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_b)
+		m_pipelineRequested = !m_pipelineRequested;
+	else if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_n)
+		m_vsyncRequested = !m_vsyncRequested;
+	else if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_f)
+	{
+		// Step through the frame rate limits, back round to no limit
+		unsigned next = 0;
+		while (next < c_numFrameRateLimits && c_frameRateLimits[next] != m_frameLimiter.getFrameRate())
+			++next;
+		setFrameRateLimit(c_frameRateLimits[(next + 1) % c_numFrameRateLimits]);
+	}
+	else
+		return false;
+	return true;
+}
+
+// Process a single event that changes the scene or the camera, on whichever thread renders
 void Application::processEvent(const SDL_Event &ev)
 {
+	// A replay takes the camera and the render settings from the recording, so keys would only change the workload
+	if (m_pathMode == PathMode::Replay || m_pathMode == PathMode::ReplayFast)
+		return;
+
 	switch (ev.type)
 	{
-	case SDL_QUIT:
-		m_quit = true;
-		break;
-
 	case SDL_KEYDOWN:
 	{
-		bool shiftMod = SDL_GetModState() & KMOD_SHIFT;
-		if (ev.key.keysym.sym == SDLK_ESCAPE)
-			m_quit = true;
-		else if (ev.key.keysym.sym == SDLK_a)
+		// Read the modifiers from the event itself, as it may be handled on the render thread
+		bool shiftMod = (ev.key.keysym.mod & KMOD_SHIFT) != 0;
+		if (ev.key.keysym.sym == SDLK_a)
 			shiftMod ? m_camera.rotateY(0.1f) : m_camera.translateX(-1.0f);
 		else if (ev.key.keysym.sym == SDLK_d)
 			shiftMod ? m_camera.rotateY(-0.1f) : m_camera.translateX(1.0f);
@@ -125,6 +262,44 @@ void Application::processEvent(const SDL_Event &ev)
 			m_camera.zoom(0.1f);
 		else if (ev.key.keysym.sym == SDLK_DOWN)
 			m_camera.zoom(-0.1f);
+		else if (ev.key.keysym.sym == SDLK_r)
+			m_camera.setVisibilityMode(m_camera.getVisibilityMode() == Camera::VisibilityMode::RayCast ?
+				Camera::VisibilityMode::Rasterise : Camera::VisibilityMode::RayCast);
+		else if (ev.key.keysym.sym == SDLK_SPACE)
+			m_animate = !m_animate;
+		else if (ev.key.keysym.sym == SDLK_t)
+		{
+			ToneMapSettings& toneMap = m_camera.getToneMapSettings();
+			toneMap.op = toneMap.op == ToneMapSettings::Operator::Clamp ? ToneMapSettings::Operator::Reinhard : ToneMapSettings::Operator::Clamp;
+		}
+		else if (ev.key.keysym.sym == SDLK_p)
+			m_camera.setPathTracing(!m_camera.getPathTracing());
+		else if (ev.key.keysym.sym == SDLK_v)
+			m_camera.setWavefront(!m_camera.getWavefront());
+		else if (ev.key.keysym.sym == SDLK_o)
+			m_camera.setSortSecondaryRays(!m_camera.getSortSecondaryRays());
+		else if (ev.key.keysym.sym == SDLK_m)
+			m_camera.setMaxReflectionDepth(m_camera.getMaxReflectionDepth() > 0 ? 0 : c_reflectionDepth);
+		else if (ev.key.keysym.sym == SDLK_h)
+		{
+			// Cycle through no shadows, shadow rays and the shadow map
+			const Camera::ShadowMode mode = m_camera.getShadowMode();
+			m_camera.setShadowMode(mode == Camera::ShadowMode::None ? Camera::ShadowMode::Rays :
+				mode == Camera::ShadowMode::Rays ? Camera::ShadowMode::Map : Camera::ShadowMode::None);
+		}
+		else if (ev.key.keysym.sym == SDLK_LEFTBRACKET || ev.key.keysym.sym == SDLK_RIGHTBRACKET)
+		{
+			// Halve or double the shadow map's resolution, which rebuilds it
+			ShadowMap& shadowMap = m_camera.getShadowMap();
+			const unsigned resolution = shadowMap.getResolution();
+			shadowMap.setResolution(ev.key.keysym.sym == SDLK_LEFTBRACKET ? max(c_minShadowMapResolution, resolution / 2) : min(c_maxShadowMapResolution, resolution * 2));
+		}
+		else if (ev.key.keysym.sym == SDLK_COMMA || ev.key.keysym.sym == SDLK_PERIOD)
+		{
+			// Halve or double the shadow map's depth bias
+			ShadowMap& shadowMap = m_camera.getShadowMap();
+			shadowMap.setDepthBias(shadowMap.getDepthBias() * (ev.key.keysym.sym == SDLK_COMMA ? 0.5f : 2.0f));
+		}
 		break;
 	}
 	default:
@@ -137,81 +312,436 @@ void Application::setupScene()
 {
 	m_camera.init(Point3D(0.0f, 0.0f, 7.5f));
 	/*
-	m_objects.push_back(new Plane(Point3D(), Vector3D(0.0f, 0.0f, 1.0f), Vector3D(0.0f, 1.0f, 0.0f), 10.0f, 7.5f));
-	m_objects[0]->m_colour = Colour(245, 121, 58);
+	m_scene.objects.push_back(new Plane(Point3D(), Vector3D(0.0f, 0.0f, 1.0f), Vector3D(0.0f, 1.0f, 0.0f), 10.0f, 7.5f));
+	m_scene.objects[0]->m_material = m_scene.materials.add(Material(Colour(245, 121, 58)));
 	*/
 	
 	
-	//m_objects.push_back(new Plane(Point3D(), Vector3D(0.5f, 0.5f, 1.0f), Vector3D(-0.5f, 1.0f, -0.25f), 10.0f, 7.5f));
-	//m_objects.push_back(new Plane(Point3D(), Vector3D(0.0f, 1.0f, 0.0f), Vector3D(1.0f, 0, 0), 10.0f, 7.5f));
-	m_objects.push_back(new Plane(Point3D(0.0f, -5.0f, -3.0f), Vector3D(0.0f, 1.0f, 0.0f), Vector3D(1.0f, 0, 0), 10.0f, 7.5f));
-	m_objects[0]->m_colour = Colour(50, 255, 50);
-	m_objects.push_back(new Sphere(Point3D(0.0f, 0.0f, -2.0f)));
-	m_objects[1]->m_colour = Colour(255,50,50);
-	m_objects[1]->m_isDynamic = true;
-
-	m_objects.push_back(new Sphere(Point3D(1.0f, 1.0f, -1.0f), 0.75f));
-	m_objects[2]->m_colour = Colour(133, 255, 125);
-	m_objects[2]->m_isDynamic = true;
+	//m_scene.objects.push_back(new Plane(Point3D(), Vector3D(0.5f, 0.5f, 1.0f), Vector3D(-0.5f, 1.0f, -0.25f), 10.0f, 7.5f));
+	//m_scene.objects.push_back(new Plane(Point3D(), Vector3D(0.0f, 1.0f, 0.0f), Vector3D(1.0f, 0, 0), 10.0f, 7.5f));
+	m_scene.objects.push_back(new Plane(Point3D(0.0f, -5.0f, -3.0f), Vector3D(0.0f, 1.0f, 0.0f), Vector3D(1.0f, 0, 0), 10.0f, 7.5f));
+	Material floor(Colour(50, 255, 50));
+	floor.reflectivity = 0.3f;
+	m_scene.objects[0]->m_material = m_scene.materials.add(floor);
+	m_scene.objects.push_back(new Sphere(Point3D(0.0f, 0.0f, -2.0f)));
+	Material mirrorSphere(Colour(255, 50, 50));
+	mirrorSphere.reflectivity = 0.5f;
+	m_scene.objects[1]->m_material = m_scene.materials.add(mirrorSphere);
+	m_scene.objects[1]->m_isDynamic = true;
+
+	m_scene.objects.push_back(new Sphere(Point3D(1.0f, 1.0f, -1.0f), 0.75f));
+	m_scene.objects[2]->m_material = m_scene.materials.add(Material(Colour(133, 255, 125)));
+	m_scene.objects[2]->m_isDynamic = true;
 	/*
-	m_objects.push_back(new Light(Point3D(5.0f, 100.0f, 5.0f), 0.5f)); //0.5f));
-	m_objects[3]->m_colour = Colour(255, 255, 255);
-	m_objects[3]->m_isDynamic = true;
+	m_scene.objects.push_back(new Light(Point3D(5.0f, 100.0f, 5.0f), 0.5f)); //0.5f));
+	m_scene.objects[3]->m_material = m_scene.materials.add(Material(Colour(255, 255, 255)));
+	m_scene.objects[3]->m_isDynamic = true;
 	*/
+
+	// A white light from above, plus a warm point light beside the spheres
+	m_scene.lights.add(LightSource::directional(Vector3D(0.0f, -1.0f, 0.0f), Colour(255, 255, 255), 0.8f));
+	m_scene.lights.add(LightSource::point(Point3D(3.0f, 1.5f, 1.0f), 6.0f, Colour(252, 165, 15), 0.6f));
+
+	// Dynamic objects orbit the world y-axis when animation is switched on
+	m_animationStep = AffineMatrix3D::fromEulerRotation(EulerSinCos(Vector3D(0.0f, c_animationAngle, 0.0f)), Point3D(), Vector3D(1.0f, 1.0f, 1.0f));
 }
 
 // Apply an update to the (dynamic) objects on each frame
 void Application::update()
 {
-	for (auto object : m_objects)
+	if (!m_animate)
+		return;
+
+	// Move all of the dynamic objects together
+	m_dynamicObjects.clear();
+	for (auto object : m_scene.objects)
 	{
 		if (object->m_isDynamic)
-		{
-			// TODO: apply a transformation to the object.
-			
+			m_dynamicObjects.push_back(object);
+	}
+	m_animation.apply(m_animationStep, m_dynamicObjects);
+}
 
+// Record the camera's pose for this frame, or set it from the path being replayed. A replay
+// renders every recorded frame, and only waits for each frame's recorded time in PathMode::Replay,
+// so two builds replaying the same file always render exactly the same frames.
+void Application::updateCameraPath()
+{
+	const Uint64 frequency = SDL_GetPerformanceFrequency();
+	const float time = static_cast<float>(static_cast<double>(SDL_GetPerformanceCounter() - m_pathStartTime) / frequency);
+
+	if (m_pathMode == PathMode::Record)
+	{
+		CameraPose pose;
+		pose.time = time;
+		pose.position = m_camera.getPosition();
+		pose.rotation = m_camera.getRotation();
+		pose.viewPlaneDistance = m_camera.getViewPlaneDistance();
+		pose.animate = m_animate;
+		pose.visibilityMode = m_camera.getVisibilityMode();
+		pose.shadowMode = m_camera.getShadowMode();
+		pose.maxReflectionDepth = m_camera.getMaxReflectionDepth();
+		pose.wavefront = m_camera.getWavefront();
+		pose.pathTracing = m_camera.getPathTracing();
+		pose.sortSecondaryRays = m_camera.getSortSecondaryRays();
+		pose.toneMap = m_camera.getToneMapSettings().op;
+		pose.shadowMapResolution = m_camera.getShadowMap().getResolution();
+		pose.shadowMapDepthBias = m_camera.getShadowMap().getDepthBias();
+		m_cameraPath.add(pose);
+	}
+	else if (m_pathMode == PathMode::Replay || m_pathMode == PathMode::ReplayFast)
+	{
+		if (m_pathFrame >= m_cameraPath.size())
+		{
+			m_quit = true;
+			return;
 		}
+
+		const CameraPose& pose = m_cameraPath[m_pathFrame];
+		if (m_pathMode == PathMode::Replay)
+			FrameLimiter::waitUntil(m_pathStartTime + static_cast<Uint64>(static_cast<double>(pose.time) * frequency));
+		m_camera.setPose(pose.position, pose.rotation, pose.viewPlaneDistance);
+		m_animate = pose.animate;
+
+		// Switch the render settings on the same frames as they were switched while recording
+		m_camera.setVisibilityMode(pose.visibilityMode);
+		m_camera.setShadowMode(pose.shadowMode);
+		m_camera.setMaxReflectionDepth(pose.maxReflectionDepth);
+		m_camera.setWavefront(pose.wavefront);
+		m_camera.setSortSecondaryRays(pose.sortSecondaryRays);
+		m_camera.getToneMapSettings().op = pose.toneMap;
+		// Changing the shadow map's resolution rebuilds it, so only do it when it changes
+		ShadowMap& shadowMap = m_camera.getShadowMap();
+		if (pose.shadowMapResolution != shadowMap.getResolution())
+			shadowMap.setResolution(pose.shadowMapResolution);
+		shadowMap.setDepthBias(pose.shadowMapDepthBias);
+		// Switching path tracing restarts its accumulation, so only do it when it changes
+		if (pose.pathTracing != m_camera.getPathTracing())
+			m_camera.setPathTracing(pose.pathTracing);
+	}
+	++m_pathFrame;
+}
+
+// Print how long the replay took, for comparing builds or settings
+void Application::reportReplay() const
+{
+	const double seconds = static_cast<double>(SDL_GetPerformanceCounter() - m_pathStartTime) / SDL_GetPerformanceFrequency();
+	const unsigned frames = min(m_pathFrame, m_cameraPath.size());
+	std::cout << "Replayed " << frames << " frames in " << seconds << " s";
+	if (frames > 0)
+		std::cout << " (" << seconds * 1000.0 / frames << " ms per frame)";
+	if (m_pathMode == PathMode::Replay && m_cameraPath.size() > 0)
+		std::cout << ", recorded in " << m_cameraPath[m_cameraPath.size() - 1].time << " s";
+	std::cout << std::endl;
+}
+
+// Wait after presenting until there is only just enough time left to render the next frame before
+// the following vsync. Rendering straight away would show input sampled a whole refresh earlier,
+// since the frame would then sit finished until the vsync came round.
+void Application::waitForInputDeadline()
+{
+	// Without vsync there's no deadline to aim for
+	if (!m_lateInput || !m_vsync || m_pathMode == PathMode::Replay || m_pathMode == PathMode::ReplayFast)
+		return;
+
+	// Frames that take longer than a refresh are presented on a later vsync, so only the remainder counts
+	const double period = m_refreshPeriod;
+	const double renderTime = m_renderEstimate + c_inputMargin;
+	const double wait = period - (renderTime - static_cast<int>(renderTime / period) * period);
+	const Uint64 frequency = SDL_GetPerformanceFrequency();
+	FrameLimiter::waitUntil(m_presentTime + static_cast<Uint64>(wait * frequency / 1000.0));
+}
+
+// Handle every event that has arrived for the frame, noting when the oldest one happened. In
+// pipelined mode this runs on the render thread, and takes the events the main thread forwarded.
+void Application::sampleInput(RenderedFrame& frame)
+{
+	frame.inputSampleTime = SDL_GetPerformanceCounter();
+	frame.oldestInputTicks = 0;
+
+	SDL_Event ev;
+	while (m_pipelined ? m_events.pop(ev) : SDL_PollEvent(&ev) != 0)
+	{
+		if (!m_pipelined && processPresentEvent(ev))
+			continue;
+		if ((ev.type == SDL_KEYDOWN || ev.type == SDL_KEYUP) && frame.oldestInputTicks == 0)
+			frame.oldestInputTicks = max(1u, ev.common.timestamp);
+		processEvent(ev);
+	}
+}
+
+// Pass the events that arrived to the render thread, apart from the ones the main thread handles
+void Application::forwardInput()
+{
+	SDL_Event ev;
+	while (SDL_PollEvent(&ev))
+	{
+		if (processPresentEvent(ev))
+			continue;
+		// The queue only fills if the render thread stalls, in which case the event is lost
+		m_events.push(ev);
 	}
 }
 
-// Render the scene (via the camera)
-void Application::render()
+// Move the camera and objects on to the next frame, and render it (via the camera)
+void Application::renderFrame(RenderedFrame& frame)
+{
+	// Record or replay the camera, then update objects' positions
+	updateCameraPath();
+	if (m_quit)
+		return;
+	update();
+
+	// Have the camera shade the scene into a linear image
+	m_threadPool.beginFrame();
+	frame.hasImage = m_camera.updatePixelBuffer(m_scene.objects);
+	if (frame.hasImage)
+		m_camera.renderImage(m_scene, frame.image);
+	m_threadPool.endFrame();
+	formatCameraStats(frame.stats, sizeof(frame.stats));
+	frame.renderedTime = SDL_GetPerformanceCounter();
+}
+
+// Show the rendered frame, and measure how long it took to reach the screen from the input it shows
+void Application::present(RenderedFrame& frame)
+{
+	// Copy the image to the screen texture, which is stretched to fill the window. Once the
+	// image and the frame's statistics are copied, the render thread can start on the frame again.
+	if (frame.hasImage)
+		SDL_UpdateTexture(m_texture, nullptr, frame.image.data(), m_camera.getViewPlaneResolutionX() * sizeof(Colour));
+	const Uint64 inputSampleTime = frame.inputSampleTime, renderedTime = frame.renderedTime;
+	const Uint32 oldestInputTicks = frame.oldestInputTicks;
+	memcpy(m_frameStats, frame.stats, sizeof(m_frameStats));
+	setFrameState(frame, RenderedFrame::Free);
+
+	SDL_RenderCopy(m_renderer, m_texture, nullptr, nullptr);
+	m_frameLimiter.wait();
+	SDL_RenderPresent(m_renderer);
+	m_presentTime = SDL_GetPerformanceCounter();
+	updateFrameRate();
+
+	// Only the time spent before the present counts towards the estimate, as that's what waitForInputDeadline() leaves room for
+	const Uint64 frequency = SDL_GetPerformanceFrequency();
+	const double renderTime = static_cast<double>(renderedTime - inputSampleTime) * 1000.0 / frequency;
+	m_renderEstimate = max(renderTime, m_renderEstimate * 0.95);
+
+	m_sampleLatency = static_cast<double>(m_presentTime - inputSampleTime) * 1000.0 / frequency;
+	m_totalSampleLatency += m_sampleLatency;
+	++m_latencyFrames;
+	if (oldestInputTicks != 0)
+		m_eventLatency = static_cast<double>(SDL_GetTicks() - oldestInputTicks);
+}
+
+// Start or stop the render thread. Frames that were rendered but not yet presented are dropped.
+void Application::setPipelined(bool pipelined)
 {
-	// Convert the image created by the camera to an SDL_Texture
-	// that can be rendered directly to the window.
-	if (m_camera.updatePixelBuffer(m_objects))
+	if (pipelined == m_pipelined)
+		return;
+
+	if (m_pipelined)
 	{
-		// Copy the data from the camera image to the screen texture,
-		// accounting for the resolution and flipped y-axis
-		static const unsigned viewPlaneWidth = m_camera.getViewPlaneResolutionX(),
-							viewPlaneHeight = m_camera.getViewPlaneResolutionY();
-		static const float x_step = static_cast<float>(c_windowWidth) / static_cast<float>(viewPlaneWidth);
-		static const float y_step = static_cast<float>(c_windowHeight) / static_cast<float>(viewPlaneHeight);
-		static SDL_FRect rect;
-		rect.x = 0.0f;
-		rect.w = x_step;
-		rect.h = y_step;
+		{
+			std::lock_guard<std::mutex> lock(m_frameStateMutex);
+			m_stopRenderThread = true;
+		}
+		m_frameStateChanged.notify_all();
+		m_renderThread.join();
+		m_pipelined = false;
+
+		// Apply any events the render thread didn't get to
+		SDL_Event ev;
+		while (m_events.pop(ev))
+			processEvent(ev);
+	}
+
+	for (RenderedFrame& frame : m_frames)
+		frame.state = RenderedFrame::Free;
+	m_presentFrame = 0;
+	m_frameRateStart = SDL_GetPerformanceCounter();
+	m_frameRateFrames = 0;
+
+	if (pipelined)
+	{
+		m_pipelined = true;
+		m_stopRenderThread = false;
+		m_renderThread = std::thread(&Application::renderThread, this);
+	}
+}
 
-		static const int iEnd = viewPlaneWidth, jStart = viewPlaneHeight - 1;
-		for (int i = 0; i < iEnd; ++i)
+// Render frames in turn into each of the two frames, as soon as the main thread has finished with them
+void Application::renderThread()
+{
+	unsigned index = 0;
+	while (!m_stopRenderThread.load(std::memory_order_acquire) && !m_quit)
+	{
+		RenderedFrame& frame = m_frames[index];
+		if (frame.state.load(std::memory_order_acquire) != RenderedFrame::Free)
 		{
-			rect.y = 0.0f;
-			for (int j = jStart; j >= 0; --j)
-			{
-				const Colour col = m_camera.getColourAtPixel(i, j, m_objects);
-				SDL_SetRenderDrawColor(m_renderer, col.r, col.g, col.b, col.a);
-				SDL_RenderFillRectF(m_renderer, &rect);
-				rect.y += y_step;
-			}
-			rect.x += x_step;
+			// Sleep until the main thread has presented the frame, or stops this thread
+			std::unique_lock<std::mutex> lock(m_frameStateMutex);
+			m_frameStateChanged.wait(lock, [&] { return frame.state.load(std::memory_order_acquire) == RenderedFrame::Free ||
+				m_stopRenderThread.load(std::memory_order_acquire) || m_quit; });
+			continue;
 		}
+
+		sampleInput(frame);
+		renderFrame(frame);
+		if (m_quit)
+			break;
+		setFrameState(frame, RenderedFrame::Ready);
+		index ^= 1;
+	}
+}
+
+// Hand a frame over to the other thread in pipelined mode, waking it if it is waiting for the frame.
+// The state is stored under the lock so the change can't slip in between a waiting thread checking
+// the state and going to sleep. Params are:
+//	frame		the frame to hand over
+//	state		RenderedFrame::Ready once it is rendered, or RenderedFrame::Free once it is presented
+void Application::setFrameState(RenderedFrame& frame, unsigned state)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_frameStateMutex);
+		frame.state.store(state, std::memory_order_release);
+	}
+	m_frameStateChanged.notify_all();
+}
+
+// Count a presented frame towards the frame rate of the current mode
+void Application::updateFrameRate()
+{
+	++m_frameRateFrames;
+	const double seconds = static_cast<double>(m_presentTime - m_frameRateStart) / SDL_GetPerformanceFrequency();
+	if (seconds >= 1.0)
+	{
+		m_frameRates[m_vsync ? 1 : 0][m_pipelined ? 1 : 0] = m_frameRateFrames / seconds;
+		m_frameRateStart = m_presentTime;
+		m_frameRateFrames = 0;
+	}
+}
+
+// Print the frame rates measured with and without pipelining, and the gain from pipelining
+void Application::reportFrameRates() const
+{
+	for (unsigned vsync = 0; vsync < 2; ++vsync)
+	{
+		const double serial = m_frameRates[vsync][0], pipelined = m_frameRates[vsync][1];
+		if (serial <= 0.0 && pipelined <= 0.0)
+			continue;
+
+		std::cout << (vsync ? "With vsync: " : "Without vsync: ") << serial << " fps serial, " << pipelined << " fps pipelined";
+		if (serial > 0.0 && pipelined > 0.0)
+			std::cout << " (" << pipelined / serial << "x)";
+		std::cout << std::endl;
+	}
+}
+
+// Write the camera's statistics for the frame it has just rendered
+void Application::formatCameraStats(char* stats, size_t size)
+{
+	const CullingStats& culling = m_camera.getCullingStats();
+	const LightCullingStats& lightCulling = m_camera.getLightCullingStats();
+	const bool rasterise = m_camera.getVisibilityMode() == Camera::VisibilityMode::Rasterise;
+
+	const Camera::ShadowMode shadowMode = m_camera.getShadowMode();
+	char shadows[96];
+	if (shadowMode == Camera::ShadowMode::Map)
+	{
+		// The build count only goes up when the light or an object moves, or the resolution changes
+		const ShadowMap& shadowMap = m_camera.getShadowMap();
+		SDL_snprintf(shadows, sizeof(shadows), "shadow map (%u texels, bias %.3f, built %u times)",
+			shadowMap.getResolution(), shadowMap.getDepthBias(), shadowMap.getBuildCount());
+	}
+	else
+		SDL_snprintf(shadows, sizeof(shadows), "%s", shadowMode == Camera::ShadowMode::Rays ? "shadow rays" : "no shadows");
+
+	SDL_snprintf(stats, size, "COMP270 - %s - culled %u/%u objects (%u behind camera) - %.1f/%u lights per tile - %s - %u reflection rays",
+		rasterise ? "rasterised" : "ray cast", culling.culled(), culling.tested, culling.behindCamera,
+		lightCulling.averageLightsPerTile(), lightCulling.lights, shadows, m_camera.getReflectionRayCount());
+#ifdef _DEBUG
+	// Debug builds check every rasterised pixel against the ray intersection tests, which should always agree
+	if (rasterise)
+	{
+		const size_t length = strlen(stats);
+		SDL_snprintf(stats + length, size - length, " - %u rasterisation mismatches", m_camera.getRasterisationMismatches());
+	}
+#endif
+	// The wavefront renderer's stage timings change on every frame, so only show them to a tenth of a millisecond
+	if (m_camera.getWavefront())
+	{
+		const WavefrontStats& stages = m_camera.getWavefrontStats();
+		const size_t length = strlen(stats);
+		SDL_snprintf(stats + length, size - length, " - wavefront %.1f/%.1f/%.1f/%.1f/%.1f ms%s",
+			stages.generateTime, stages.shadowTime, stages.reflectTime, stages.shadeTime, stages.intersectTime,
+			m_camera.getSortSecondaryRays() ? ", sorted reflections" : "");
+	}
+	if (m_camera.getPathTracing())
+	{
+		const size_t length = strlen(stats);
+		SDL_snprintf(stats + length, size - length, " - path traced, %u samples", m_camera.getPathTracer().getNumSamples());
+	}
+
+	// How much of the frame each of the pool's threads spent working, starting with this one
+	const std::vector<ThreadPoolStats>& threads = m_threadPool.getStats();
+	for (unsigned t = 0; t < threads.size(); ++t)
+	{
+		const size_t length = strlen(stats);
+		SDL_snprintf(stats + length, size - length, t == 0 ? " - threads %.0f" : "/%.0f", threads[t].utilisation * 100.0f);
+	}
+	if (!threads.empty())
+	{
+		const size_t length = strlen(stats);
+		SDL_snprintf(stats + length, size - length, "%%");
+	}
+}
+
+// Show the per-frame statistics in the window title, only updating it when they change
+void Application::updateWindowTitle()
+{
+	char title[560];
+	const double frameRate = m_frameRates[m_vsync ? 1 : 0][m_pipelined ? 1 : 0];
+	SDL_snprintf(title, sizeof(title), "%s - latency %.1f ms (last key %.0f ms)%s - %.0f fps%s%s", m_frameStats,
+		m_sampleLatency, m_eventLatency, m_lateInput && m_vsync && !m_pipelined ? ", late input" : "", frameRate,
+		m_pipelined ? " pipelined" : "", m_vsync ? "" : " uncapped");
+	if (m_frameLimiter.getFrameRate() > 0)
+	{
+		const size_t length = strlen(title);
+		SDL_snprintf(title + length, sizeof(title) - length, " (limit %u)", m_frameLimiter.getFrameRate());
+	}
+	if (m_windowTitle != title)
+	{
+		m_windowTitle = title;
+		SDL_SetWindowTitle(m_window, title);
 	}
 }
 
 // Application entry point
-int main(int, char**)
+int main(int argc, char** argv)
 {
+	// "--benchmark <name>" runs one of the benchmarks in Benchmark.cpp instead of opening the window
+	if (argc > 2 && strcmp(argv[1], "--benchmark") == 0)
+		return runBenchmark(argv[2]) ? 0 : 1;
+
+	// "--record <file>" saves the camera's path; "--replay <file>" plays it back at the recorded
+	// speed, and "--replay-fast <file>" plays it back as fast as the frames can be rendered.
+	// "--no-vsync" starts uncapped, for benchmarking, and "--fps-limit <n>" caps the frame rate.
 	Application application;
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		const Application::PathMode mode = strcmp(argv[arg], "--record") == 0 ? Application::PathMode::Record :
+			strcmp(argv[arg], "--replay") == 0 ? Application::PathMode::Replay :
+			strcmp(argv[arg], "--replay-fast") == 0 ? Application::PathMode::ReplayFast : Application::PathMode::None;
+		if (mode != Application::PathMode::None && arg + 1 < argc)
+		{
+			if (!application.setPathMode(mode, argv[++arg]))
+				return 1;
+		}
+		else if (strcmp(argv[arg], "--no-vsync") == 0)
+			application.setStartupVsync(false);
+		else if (strcmp(argv[arg], "--fps-limit") == 0 && arg + 1 < argc)
+			application.setFrameRateLimit(static_cast<unsigned>(atoi(argv[++arg])));
+	}
+
 	if (application.run())
 		return 0;
 	else
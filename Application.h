@@ -1,5 +1,14 @@
 #pragma once
 #include "Camera.h"
+#include "CameraPath.h"
+#include "SpscQueue.h"
+#include "FrameLimiter.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 class Object;
 
@@ -11,23 +20,139 @@ public:
 
 	bool run();
 
+	// What run() does with the camera path file
+	enum class PathMode
+	{
+		None,
+		Record,			// Save the camera's pose on every frame to the file when the application quits
+		Replay,			// Play the file back, rendering each frame at the time it was recorded
+		ReplayFast,		// Play the file back, rendering each frame as soon as the last one is presented
+	};
+
+	// Choose whether to record or replay the camera path; must be called before run()
+	// Return false if the path to replay can't be loaded
+	bool setPathMode(PathMode mode, const char* filename);
+
+	// Choose whether the renderer waits for vsync when it is first created; it can be switched
+	// at any time afterwards with the N key
+	void setStartupVsync(bool vsync) { m_vsync = vsync; m_vsyncRequested = vsync; }
+
+	// Cap the frame rate without vsync (0 for no cap); the F key steps through c_frameRateLimits
+	void setFrameRateLimit(unsigned framesPerSecond);
+
 private:
 	bool initSDL();
+	bool createRenderer();
+	bool setVsync(bool vsync);
 	void shutdownSDL();
 
+	// A frame rendered by the camera, waiting to be presented, and when the input it shows was sampled
+	struct RenderedFrame
+	{
+		enum State : unsigned
+		{
+			Free,		// Waiting to be rendered
+			Ready,		// Rendered, and waiting to be presented
+		};
+
+		std::vector<Colour> image;		// The camera image, as rows of RGBA pixels from top to bottom
+		bool hasImage = false;			// False if the camera had nothing to draw
+		Uint64 inputSampleTime = 0;		// Performance counter value when the frame's input was sampled
+		Uint32 oldestInputTicks = 0;	// SDL timestamp of the first input event handled for the frame, or 0 if there was none
+		Uint64 renderedTime = 0;		// Performance counter value when the image was finished
+		char stats[400] = {};			// The camera's statistics for the frame, for the window title
+		std::atomic<unsigned> state{ Free };	// Passes the frame between the render thread and the main thread in pipelined mode
+	};
+
+	bool processPresentEvent(const SDL_Event &e);
 	void processEvent(const SDL_Event &e);
 	void setupScene();
+	void waitForInputDeadline();
+	void sampleInput(RenderedFrame& frame);
+	void forwardInput();
 	void update();
-	void render();
+	void updateCameraPath();
+	void reportReplay() const;
+	void renderFrame(RenderedFrame& frame);
+	void present(RenderedFrame& frame);
+	void setPipelined(bool pipelined);
+	void renderThread();
+	void setFrameState(RenderedFrame& frame, unsigned state);
+	void updateFrameRate();
+	void reportFrameRates() const;
+	void formatCameraStats(char* stats, size_t size);
+	void updateWindowTitle();
 
 	const int c_windowWidth = 800;
 	const int c_windowHeight = 700;
+	const float c_animationAngle = 0.02f;	// Angle that dynamic objects orbit the world y-axis by on each frame (radians)
+	const unsigned c_reflectionDepth = 3;	// Number of reflection bounces when reflections are switched on
+	const unsigned c_minShadowMapResolution = 64;	// Range the [ and ] keys change the shadow map's resolution within
+	const unsigned c_maxShadowMapResolution = 4096;
+	const double c_inputMargin = 2.0;		// Time left spare between rendering a frame and the vsync it is presented on (ms)
+	const std::chrono::milliseconds c_inputForwardInterval{ 1 };	// How often the main thread passes on input while it waits for a pipelined frame
+	static const unsigned c_numFrameRateLimits = 4;
+	const unsigned c_frameRateLimits[c_numFrameRateLimits] = { 0, 30, 60, 144 };	// Frame rate caps the F key steps through (0 for none)
 
 	SDL_Window* m_window = nullptr;
 	SDL_Renderer* m_renderer = nullptr;
+	SDL_Texture* m_texture = nullptr;	// Holds the camera image, stretched over the window when presented
 
-	bool m_quit = false;
+	std::atomic<bool> m_quit{ false };	// Set on either thread in pipelined mode
+	std::string m_windowTitle;	// The statistics currently shown in the window title
+	char m_frameStats[400] = {};	// The camera's statistics for the last frame presented
 
-	std::vector<Object*> m_objects;
+	Scene m_scene;							// The objects and their materials
+	std::vector<Object*> m_dynamicObjects;	// The objects that are moved by update(), refilled on each frame
+	ObjectTransformBatch m_animation;		// Applies the per-frame movement to the dynamic objects
+	AffineMatrix3D m_animationStep;			// The movement applied to dynamic objects on each frame
+	bool m_animate = false;					// Whether dynamic objects are moving
 	Camera m_camera;
+	ThreadPool m_threadPool;				// Runs the camera's parallel loops; started and stopped by run()
+
+	// Input is sampled as late as possible before rendering: after presenting, the main loop waits
+	// until just enough time is left to render the next frame before the following vsync
+	bool m_lateInput = true;
+	double m_refreshPeriod = 1000.0 / 60.0;	// Time between vsyncs (ms)
+	double m_renderEstimate = 0.0;			// Expected time from sampling input to presenting, slowly decaying from the worst recent frame (ms)
+	Uint64 m_presentTime = 0;				// Performance counter value when the last frame was presented
+
+	// Input-to-present latency of the last frame (ms): from sampling the input, and from the
+	// first input event, which is only measured on frames that had one
+	double m_sampleLatency = 0.0;
+	double m_eventLatency = 0.0;
+	double m_totalSampleLatency = 0.0;		// Sums over every frame, for the average reported when the application quits
+	unsigned m_latencyFrames = 0;
+
+	// In pipelined mode a render thread samples the input and renders each frame while the main
+	// thread presents the one before. The two frames are handed back and forth through their
+	// atomic states; the main thread forwards the input events. A thread that finds the frame it
+	// needs in the wrong state sleeps on the condition variable, which is signalled whenever a
+	// state changes or the render thread is stopped, rather than spinning.
+	// Otherwise the main thread renders and presents each frame in turn, using only the first frame.
+	RenderedFrame m_frames[2];
+	bool m_pipelined = false;
+	bool m_pipelineRequested = false;		// Set by the B key; the switch happens between frames
+	unsigned m_presentFrame = 0;			// Index of the next frame the main thread presents
+	std::thread m_renderThread;
+	std::atomic<bool> m_stopRenderThread{ false };
+	std::mutex m_frameStateMutex;
+	std::condition_variable m_frameStateChanged;
+	SpscQueue<SDL_Event, 256> m_events;		// Input events for the render thread
+
+	// Frames presented per second, measured over about a second at a time, for each combination
+	// of vsync (on or off) and pipelining (off or on), so the gain from pipelining can be compared
+	bool m_vsync = true;
+	bool m_vsyncRequested = true;			// Set by the N key; the renderer is replaced between frames
+	double m_frameRates[2][2] = {};
+	Uint64 m_frameRateStart = 0;			// Performance counter value when the current measurement started
+	unsigned m_frameRateFrames = 0;			// Frames presented since then
+
+	FrameLimiter m_frameLimiter;			// Paces the presents when a frame rate cap is set
+
+	PathMode m_pathMode = PathMode::None;
+	std::string m_pathFilename;
+	CameraPath m_cameraPath;		// The poses being recorded or replayed
+	unsigned m_pathFrame = 0;		// Index of the next pose to record or replay
+	Uint64 m_pathStartTime = 0;		// Performance counter value when the first frame started
 };
@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "SpecularPower.h"
+#include "Camera.h"
+#include "ThreadPool.h"
+#include <chrono>
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Returns the number of nanoseconds per item taken since the start time
+	double nanosecondsPerItem(Clock::time_point start, size_t items)
+	{
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / items;
+	}
+
+	// Times SpecularPower against pow() for a typical spread of R DOT V values, and checks
+	// that its results stay within the error bound for each path
+	bool runSpecularBenchmark()
+	{
+		const unsigned numValues = 1 << 20, repeats = 20;
+		const float exponents[] = { 1.0f, 5.0f, 10.0f, 32.0f, 64.0f, 0.5f, 1.5f, 2.5f, 12.5f, 100.0f };
+		const double c_roundingTolerance = 1e-6;
+
+		// Values from 0 to 1 in a scattered order, so the table path doesn't get ordered memory accesses for free
+		std::vector<float> values(numValues);
+		unsigned seed = 12345;
+		for (auto& value : values)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			value = (seed >> 8) * (1.0f / (1 << 24));
+		}
+
+		bool passed = true;
+		std::cout << "exponent  path     pow() ns  specular ns  speed-up  max error  bound" << std::endl;
+		for (float exponent : exponents)
+		{
+			SpecularPower power;
+			power.setExponent(exponent);
+
+			volatile float sink = 0.0f;
+			Clock::time_point start = Clock::now();
+			for (unsigned r = 0; r < repeats; ++r)
+			{
+				float sum = 0.0f;
+				for (float value : values)
+					sum += powf(value, exponent);
+				sink = sink + sum;
+			}
+			const double powTime = nanosecondsPerItem(start, numValues * repeats);
+
+			start = Clock::now();
+			for (unsigned r = 0; r < repeats; ++r)
+			{
+				float sum = 0.0f;
+				for (float value : values)
+					sum += power(value);
+				sink = sink + sum;
+			}
+			const double specularTime = nanosecondsPerItem(start, numValues * repeats);
+
+			// Accuracy against double precision pow(). The integer kernels only lose a few bits of
+			// rounding; the table is allowed the analytic interpolation bound, plus the rounding of its
+			// float entries. It is not checked against the error it measured itself when it was built.
+			double maxError = 0.0, bound = 0.0;
+			for (unsigned k = 0; k <= numValues; ++k)
+			{
+				const double x = static_cast<double>(k) / numValues, expected = pow(x, static_cast<double>(exponent));
+				const double error = fabs(power(static_cast<float>(x)) - expected);
+				maxError = max(maxError, power.usesTable() ? error : error / max(expected, 1e-30));
+			}
+			if (power.usesTable())
+				bound = SpecularPower::getErrorBound(exponent) + c_roundingTolerance;
+			else
+				bound = exponent * 1e-6 + 1e-6;
+
+			const bool accurate = maxError <= bound;
+			passed = passed && accurate;
+
+			char line[128];
+			SDL_snprintf(line, sizeof(line), "%8.1f  %-7s  %8.2f  %11.2f  %7.2fx  %9.2e  %8.2e%s",
+				exponent, power.usesTable() ? "table" : "integer", powTime, specularTime, powTime / specularTime,
+				maxError, bound, accurate ? "" : "  FAILED");
+			std::cout << line << std::endl;
+		}
+
+		std::cout << (passed ? "All specular powers are within their error bounds" : "Some specular powers exceeded their error bounds") << std::endl;
+		return passed;
+	}
+
+	// Times the camera's wavefront renderer with and without sorting its reflection rays, as the
+	// application runs it: on the thread pool, with the secondary ray budget and the minimum sort
+	// size. Checks that both orders give the same image. The scene is a field of mirrored spheres
+	// over a reflective floor, seen from above.
+	bool runRaySortBenchmark()
+	{
+		const unsigned gridSize = 16, repeats = 50;
+
+		Scene scene;
+		Material floor(Colour(50, 255, 50));
+		floor.reflectivity = 0.3f;
+		scene.objects.push_back(new Plane(Point3D(0.0f, -1.0f, 0.0f), Vector3D(0.0f, 1.0f, 0.0f), Vector3D(0.0f, 0.0f, 1.0f), 80.0f, 80.0f));
+		scene.objects[0]->m_material = scene.materials.add(floor);
+
+		Material mirror(Colour(255, 50, 50));
+		mirror.reflectivity = 0.5f;
+		const unsigned mirrorMaterial = scene.materials.add(mirror);
+		unsigned seed = 12345;
+		for (unsigned i = 0; i < gridSize; ++i)
+		{
+			for (unsigned j = 0; j < gridSize; ++j)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const float radius = 0.4f + (seed >> 8) * (0.5f / (1 << 24));
+				scene.objects.push_back(new Sphere(Point3D(i * 2.5f - 20.0f, radius - 1.0f, j * -2.5f), radius));
+				scene.objects.back()->m_material = mirrorMaterial;
+			}
+		}
+		scene.lights.add(LightSource::directional(Vector3D(0.0f, -1.0f, 0.0f), Colour(255, 255, 255), 0.8f));
+
+		ThreadPool threadPool;
+		threadPool.start();
+
+		Camera camera;
+		camera.init(Point3D(0.0f, 6.0f, 12.0f));
+		camera.rotateX(-0.4f);
+		camera.setWavefront(true);
+
+		// Time each order over the same frames, after one frame to settle the allocations
+		std::vector<Colour> images[2];
+		double frameTimes[2] = {}, intersectTimes[2] = {};
+		for (unsigned sorted = 0; sorted < 2; ++sorted)
+		{
+			camera.setSortSecondaryRays(sorted != 0);
+			for (unsigned r = 0; r <= repeats; ++r)
+			{
+				Clock::time_point start = Clock::now();
+				camera.updatePixelBuffer(scene.objects);
+				camera.renderImage(scene, images[sorted]);
+				if (r == 0)
+					continue;
+				frameTimes[sorted] += std::chrono::duration<double, std::milli>(Clock::now() - start).count() / repeats;
+				intersectTimes[sorted] += camera.getWavefrontStats().intersectTime / repeats;
+			}
+		}
+		const unsigned numThreads = threadPool.getNumThreads();
+		threadPool.stop();
+
+		const bool matched = memcmp(images[0].data(), images[1].data(), images[0].size() * sizeof(Colour)) == 0;
+
+		char line[128];
+		SDL_snprintf(line, sizeof(line), "%u reflection rays a frame against %u objects, on %u threads",
+			camera.getReflectionRayCount(), static_cast<unsigned>(scene.objects.size()), numThreads);
+		std::cout << line << std::endl;
+		SDL_snprintf(line, sizeof(line), "unsorted  %8.2f ms/frame  %8.2f ms intersecting", frameTimes[0], intersectTimes[0]);
+		std::cout << line << std::endl;
+		SDL_snprintf(line, sizeof(line), "sorted    %8.2f ms/frame  %8.2f ms intersecting, including the sort  %.2fx",
+			frameTimes[1], intersectTimes[1], frameTimes[0] / frameTimes[1]);
+		std::cout << line << std::endl;
+		std::cout << (matched ? "Sorted and unsorted rays gave the same image" : "Sorted and unsorted rays gave different images") << std::endl;
+
+		for (auto obj : scene.objects)
+			delete obj;
+		return matched;
+	}
+}
+
+// Runs the named benchmark. Params are:
+//	name	"specular" to compare the specular power kernels with pow(),
+//			"raysort" to compare wavefront rendering with and without sorting the reflection rays
+bool runBenchmark(const char* name)
+{
+	if (strcmp(name, "specular") == 0)
+		return runSpecularBenchmark();
+	if (strcmp(name, "raysort") == 0)
+		return runRaySortBenchmark();
+
+	std::cout << "Unknown benchmark: " << name << std::endl;
+	return false;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Runs the named benchmark instead of the application, e.g. with "--benchmark specular" on the command line.
+// Returns false if the benchmark doesn't exist or its accuracy checks fail.
+bool runBenchmark(const char* name);
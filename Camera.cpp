@@ -1,7 +1,16 @@
 #include "stdafx.h"
 #include "Camera.h"
 #include "Object.h"
+#include "ParallelFor.h"
 #include <iostream>
+
+float clamp(float input, float lb, float ub){ 
+	//return (input < lb) ? lb : ((input > ub) ? ub : input); 
+	if (input < lb) { return lb; }
+	else if (input > ub) { return ub; }
+	else return input;
+}
+
 // Initialises the camera at the given position
 void Camera::init(const Point3D& pos)
 {
@@ -21,62 +30,123 @@ bool Camera::updatePixelBuffer(const std::vector<Object*>& objects)
 {
 	if (m_pixelBuf.isInitialised())
 	{
-		m_pixelBuf.clear();
+		if (m_storeNormals != m_pixelBuf.hasNormals())
+			m_pixelBuf.init(m_viewPlane.resolutionX, m_viewPlane.resolutionY, m_storeNormals);
+		else
+			m_pixelBuf.clear();
 
 		// Make sure our cached values are up to date
 		if (m_worldTransformChanged)
 		{
-			updateWorldTransform();
-			updateLightTransform();
+			updateTransforms();
 			m_worldTransformChanged = false;
 		}
 
 		// Transform the objects to the camera's coordinate system
-		const Matrix3D worldToCameraTransform = m_cameraToWorldTransform.inverseTransform();
-
+		m_objectTransforms.apply(m_cameraToWorldTransform.inverse(), objects);
+		
+		// Keep the frustum and ray directions in step with the view plane
+		if (m_viewPlaneChanged)
+		{
+			m_frustum.set(m_viewPlane.distance, m_viewPlane.halfWidth, m_viewPlane.halfHeight);
+			m_rayDirections.build(m_viewPlane.distance, m_viewPlane.halfWidth, m_viewPlane.halfHeight,
+				m_viewPlane.resolutionX, m_viewPlane.resolutionY);
+			m_viewPlaneChanged = false;
+		}
 
-		for (auto obj : objects) {
-			obj->applyTransformation(worldToCameraTransform);
-			
+		// Cull objects that are behind the camera or outside the view plane,
+		// testing the camera space bounds of all objects together
+		const unsigned numObjects = static_cast<unsigned>(objects.size());
+		m_objectBounds.resize(numObjects);
+		for (unsigned k = 0; k < numObjects; ++k)
+			m_objectBounds.set(k, objects[k]->position(), fabsf(objects[k]->getMaxRadius()));
+		m_frustum.cullSpheres(m_objectBounds, m_objectVisible, m_cullingStats);
+
+		// Find the range of pixels that might be covered by each object,
+		// clamped to the view plane resolution
+		m_visibleObjects.clear();
+		for (unsigned k = 0; k < numObjects; ++k)
+		{
+			if (!m_objectVisible[k])
+				continue;
+
+			VisibleObject visible;
+			visible.object = objects[k];
+			visible.index = k;
+			if (!getPixelBounds(visible.object->position(), fabsf(visible.object->getMaxRadius()), visible.startX, visible.endX, visible.startY, visible.endY))
+				continue;
+
+			visible.sphere = dynamic_cast<const Sphere*>(visible.object);
+			visible.plane = dynamic_cast<const Plane*>(visible.object);
+			m_visibleObjects.push_back(visible);
 		}
-		
-		// Fill the pixel buffer with pointers to the closest object for each pixel
-		Point3D origin;
-		Vector3D rayDir;
-		float distToIntersection;
-		for (const auto obj : objects)
+
+		// Fill the pixel buffer with pointers to the closest object for each pixel. Bands of
+		// tile rows are shared between the threads, and each band draws the objects' rows
+		// within it in the same order, so the result is the same for any number of threads.
+		m_rasterisationMismatches = 0;
+		const unsigned tileSize = PixelBuffer::c_tileSize;
+		const auto drawBands = [&](unsigned begin, unsigned end)
+		{
+			const unsigned bandStartY = begin * tileSize, bandEndY = min(end * tileSize, m_viewPlane.resolutionY);
+			for (const VisibleObject& visible : m_visibleObjects)
+			{
+				const unsigned startY = max(visible.startY, bandStartY), endY = min(visible.endY, bandEndY);
+				if (startY >= endY)
+					continue;
+
+				if (m_visibilityMode == VisibilityMode::Rasterise && visible.sphere != nullptr)
+					rasteriseSphere(visible.sphere, visible.index, visible.startX, visible.endX, startY, endY);
+				else if (m_visibilityMode == VisibilityMode::Rasterise && visible.plane != nullptr)
+					rasterisePlane(visible.plane, visible.index, visible.startX, visible.endX, startY, endY);
+				else
+					castRays(visible.object, visible.index, visible.startX, visible.endX, startY, endY);
+			}
+		};
+		// Validating rasterised objects shares one scratch buffer and counter between them, so it stays on this thread
+		const unsigned numBands = (m_viewPlane.resolutionY + tileSize - 1) / tileSize;
+		if (m_validateRasterisation && m_visibilityMode == VisibilityMode::Rasterise)
+			drawBands(0, numBands);
+		else
+			parallelFor(numBands, 1, drawBands);
+
+		if (m_storeNormals)
+			storeNormals(objects);
+
+		// Now put the objects back!
+		m_objectTransforms.apply(m_cameraToWorldTransform.matrix(), objects);
+		return true;
+	}
+	
+	return false;
+}
+
+// Tests the rays through each of the given pixels against the object, and stores the object
+// in the pixel buffer wherever it is the closest intersection so far
+// Params:
+//	obj							the object, in camera space
+//	objectIndex					the index of the object in the scene's object list
+//	startX, endX, startY, endY	the range of pixels that might be covered by the object
+void Camera::castRays(const Object* obj, unsigned objectIndex, unsigned startX, unsigned endX, unsigned startY, unsigned endY)
+{
+	Point3D origin;
+	Vector3D rayDir;
+	float distToIntersection;
+
+	// For each of the pixels that might be covered by the object, find the direction
+	// of the ray passing through it and test whether it intersects with the object.
+	// The pixels are visited one pixel buffer tile at a time, to stay within the
+	// memory that has most recently been touched.
+	const unsigned tileSize = PixelBuffer::c_tileSize;
+	for (unsigned tileStartY = startY; tileStartY < endY; tileStartY = (tileStartY / tileSize + 1) * tileSize)
+	{
+		const unsigned tileEndY = min((tileStartY / tileSize + 1) * tileSize, endY);
+		for (unsigned tileStartX = startX; tileStartX < endX; tileStartX = (tileStartX / tileSize + 1) * tileSize)
 		{
-			// Find the pixel that's intersected by the line from the
-			// camera to the object's centre
-			Vector3D toCentre = obj->position().asVector();
-			toCentre.normalise();
-				
-			// Centre line intersects the view plane when the z value
-			// is the distance to the view plane
-			const float t = m_viewPlane.distance / toCentre.z;
-			const float viewPlaneX = toCentre.x * t + m_viewPlane.halfWidth,
-					viewPlaneY = toCentre.y * t + m_viewPlane.halfHeight;
-				
-			// Find the pixel indices of the centre line intersection point
-			const int pixelX = static_cast<int>(viewPlaneX / m_pixelWidth),
-					pixelY = static_cast<int>(viewPlaneY / m_pixelHeight);
-
-			// Find the largest range of pixels that the object might cover,
-			// based on its maximum 'radius'.
-			const float objectRad = fabsf(obj->getMaxRadius());
-			const int pixelRadiusX = static_cast<int>(objectRad / m_pixelWidth) + 1,
-					pixelRadiusY = static_cast<int>(objectRad / m_pixelHeight) + 1;
-				
-			// Find the range of pixels that might be covered by the object,
-			// clamped to the view plane resolution
-			const unsigned startX = max(pixelX - pixelRadiusX, 0), endX = min(pixelX + pixelRadiusX, m_viewPlane.resolutionX),
-					startY = max(pixelY - pixelRadiusY, 0), endY = min(pixelY + pixelRadiusY, m_viewPlane.resolutionY);
-			
-			// For each of the pixels that might be covered by the object, find the direction
-			// of the ray passing through it and test whether it intersects with the object
-			for (unsigned i = startX; i < endX; ++i)
+			const unsigned tileEndX = min((tileStartX / tileSize + 1) * tileSize, endX);
+			for (unsigned j = tileStartY; j < tileEndY; ++j)
 			{
-				for (unsigned j = startY; j < endY; ++j)
+				for (unsigned i = tileStartX; i < tileEndX; ++i)
 				{
 //--------------------------------------------------------------------------------------------------------------------//
 					// TODO: if you want to pass through any extra information from the intersection test
@@ -86,170 +156,386 @@ bool Camera::updatePixelBuffer(const std::vector<Object*>& objects)
 					// Perform the intersection test between the ray through this pixel and the object,
 					// and check whether the intersection point is closer than that of previously tested objects
 					if (obj->getIntersection(origin, rayDir, distToIntersection)	
-						&& distToIntersection < m_pixelBuf.getObjectInfoForPixel(i, j).distanceToIntersection)
+						&& distToIntersection < m_pixelBuf.getDepth(i, j))
 					{
-						m_pixelBuf.setObjectInfoForPixel(i, j, ObjectInfo(obj, distToIntersection));
+						m_pixelBuf.setPixel(i, j, objectIndex, distToIntersection);
 						
 					}
 //--------------------------------------------------------------------------------------------------------------------//
 				}
 			}
 		}
+	}
+}
 
-		// Now put the objects back!
-		for (auto obj : objects) {
-			obj->applyTransformation(m_cameraToWorldTransform);
-		}
-		return true;
+// Shrinks the interval (start, end) to the part where g*x + h > 0.
+// Returns false if the interval becomes empty.
+static bool clipToHalfLine(double g, double h, double& start, double& end)
+{
+	if (fabs(g) < 1e-12)
+	{
+		if (h <= 0.0)
+			return false;
 	}
-	
-	return false;
+	else if (g > 0.0)
+		start = max(start, -h / g);
+	else
+		end = min(end, -h / g);
+
+	return start < end;
 }
 
-//--------------------------------------------------------------------------------------------------------------------//
+// Finds the intervals of x for which both a*x^2 + b*x + c > 0 and g*x + h > 0.
+// Returns the number of intervals (0, 1 or 2), which are written to spans as (start, end) pairs.
+static unsigned findSpans(double a, double b, double c, double g, double h, double spans[4])
+{
+	const double inf = DBL_MAX, epsilon = 1e-12;
 
-// Calculates the normalised direction in camera space of a ray from
-// the camera through the view-plane pixel at index (i, j),
-// where 0 <= i < m_viewPlane.resolutionX and 0 <= j < m_viewPlane.resolutionY.
-Vector3D Camera::getRayDirectionThroughPixel(int i, int j)
+	// Intervals where the quadratic is positive
+	double quadSpans[4];
+	unsigned numQuadSpans = 0;
+	if (fabs(a) < epsilon)
+	{
+		// Linear (or constant) rather than quadratic
+		if (fabs(b) < epsilon)
+		{
+			if (c > 0.0)
+			{
+				quadSpans[0] = -inf; quadSpans[1] = inf;
+				numQuadSpans = 1;
+			}
+		}
+		else
+		{
+			quadSpans[0] = b > 0.0 ? -c / b : -inf;
+			quadSpans[1] = b > 0.0 ? inf : -c / b;
+			numQuadSpans = 1;
+		}
+	}
+	else
+	{
+		const double disc = b * b - 4.0 * a * c;
+		if (disc > 0.0)
+		{
+			// Numerically stable form of the quadratic formula
+			const double q = -0.5 * (b + (b >= 0.0 ? sqrt(disc) : -sqrt(disc)));
+			double root1 = q / a, root2 = c / q;
+			if (root1 > root2)
+			{
+				const double tmp = root1; root1 = root2; root2 = tmp;
+			}
+
+			if (a < 0.0)
+			{
+				quadSpans[0] = root1; quadSpans[1] = root2;
+				numQuadSpans = 1;
+			}
+			else
+			{
+				quadSpans[0] = -inf; quadSpans[1] = root1;
+				quadSpans[2] = root2; quadSpans[3] = inf;
+				numQuadSpans = 2;
+			}
+		}
+		else if (a > 0.0)
+		{
+			quadSpans[0] = -inf; quadSpans[1] = inf;
+			numQuadSpans = 1;
+		}
+	}
+
+	// Half-line where the linear term is positive
+	double lineStart = -inf, lineEnd = inf;
+	if (!clipToHalfLine(g, h, lineStart, lineEnd))
+		return 0;
+
+	unsigned numSpans = 0;
+	for (unsigned n = 0; n < numQuadSpans; ++n)
+	{
+		const double spanStart = max(quadSpans[2 * n], lineStart), spanEnd = min(quadSpans[2 * n + 1], lineEnd);
+		if (spanStart < spanEnd)
+		{
+			spans[2 * numSpans] = spanStart;
+			spans[2 * numSpans + 1] = spanEnd;
+			++numSpans;
+		}
+	}
+	return numSpans;
+}
+
+// Finds the pixels covered by a sphere one scanline at a time. The rays through a row of pixels
+// are d = (x, y, distance) for a fixed y, and the ray hits the sphere when both C.d > 0 and
+// (C.d)^2 - |d|^2 (|C|^2 - r^2) > 0, which is a quadratic in x, so the first and last pixels
+// of each row can be found in closed form. The depth along each span is then found from
+// forward differences of the same quadratic, with no per-pixel intersection tests.
+// Params:
+//	sphere						the sphere, in camera space
+//	objectIndex					the index of the sphere in the scene's object list
+//	startX, endX, startY, endY	the range of pixels that might be covered by the sphere
+void Camera::rasteriseSphere(const Sphere* sphere, unsigned objectIndex, unsigned startX, unsigned endX, unsigned startY, unsigned endY)
 {
-	Vector3D rayDir;
-	Vector3D worldPos(i, j, m_viewPlane.distance); //Vector3D Representing the point in space the ray is colliding with.
-	
+	const Point3D& centre = sphere->position();
+	const double cx = centre.x, cy = centre.y, cz = centre.z;
+	const double k = cx * cx + cy * cy + cz * cz - static_cast<double>(sphere->getRadius()) * sphere->getRadius();
+	const double d = m_viewPlane.distance, pixelWidth = m_pixelWidth;
 
-	rayDir = Vector3D(
-		worldPos.x * m_pixelWidth - m_viewPlane.halfWidth, 
-		worldPos.y * m_pixelHeight - m_viewPlane.halfHeight, 
-		worldPos.z);
-	rayDir.normalise();
-		
-	return rayDir;
+	const unsigned rectWidth = endX - startX;
+	if (m_validateRasterisation)
+		m_rasterDepths.assign(rectWidth * (endY - startY), FLT_MAX);
+
+	for (unsigned j = startY; j < endY; ++j)
+	{
+		// Coefficients of the coverage quadratic for this row, a*x^2 + b*x + c
+		const double y = static_cast<double>(j) * m_pixelHeight - m_viewPlane.halfHeight;
+		const double m = y * cy + d * cz;					// C.d = x * cx + m
+		const double yd2 = y * y + d * d;					// |d|^2 = x^2 + yd2
+		const double a = cx * cx - k, b = 2.0 * cx * m, c = m * m - yd2 * k;
+
+		double spans[4];
+		const unsigned numSpans = findSpans(a, b, c, cx, m, spans);
+		for (unsigned n = 0; n < numSpans; ++n)
+		{
+			// Convert the span to pixel indices, where pixel i has x = i * pixelWidth - halfWidth
+			const double first = ceil((spans[2 * n] + m_viewPlane.halfWidth) / pixelWidth),
+				last = floor((spans[2 * n + 1] + m_viewPlane.halfWidth) / pixelWidth) + 1.0;
+			const unsigned spanStart = static_cast<unsigned>(max(first, static_cast<double>(startX))),
+				spanEnd = static_cast<unsigned>(min(last, static_cast<double>(endX)));
+			if (spanStart >= spanEnd)
+				continue;
+
+			// Starting values and forward differences for C.d, |d|^2 and the quadratic
+			const double x = static_cast<double>(spanStart) * pixelWidth - m_viewPlane.halfWidth;
+			double dotCentre = x * cx + m;
+			double length2 = x * x + yd2, lengthStep = 2.0 * x * pixelWidth + pixelWidth * pixelWidth;
+			double quad = (a * x + b) * x + c, quadStep = a * lengthStep + b * pixelWidth;
+			const double dotCentreStep = cx * pixelWidth, lengthStep2 = 2.0 * pixelWidth * pixelWidth, quadStep2 = a * lengthStep2;
+
+			for (unsigned i = spanStart; i < spanEnd; ++i)
+			{
+				// Distance along the normalised ray: (C.d - sqrt(quadratic)) / |d|
+				const float distToIntersection = static_cast<float>((dotCentre - sqrt(max(quad, 0.0))) / sqrt(length2));
+				if (distToIntersection < m_pixelBuf.getDepth(i, j))
+					m_pixelBuf.setPixel(i, j, objectIndex, distToIntersection);
+
+				if (m_validateRasterisation)
+					m_rasterDepths[(i - startX) + rectWidth * (j - startY)] = distToIntersection;
+
+				dotCentre += dotCentreStep;
+				length2 += lengthStep;
+				lengthStep += lengthStep2;
+				quad += quadStep;
+				quadStep += quadStep2;
+			}
+		}
+	}
+
+	if (m_validateRasterisation)
+		validateRasterisation(sphere, startX, endX, startY, endY, m_rasterDepths);
 }
 
-// Computes the transformation of the camera in world space, which is also the
-// transform that will take objects from camera to world coordinates
-// and stores it in m_cameraToWorldTransform
-void Camera::updateWorldTransform()
+// Finds the pixels covered by a plane one scanline at a time. For the ray d = (x, y, distance)
+// the intersection is at t*d, where 1/t = (d.n)/(P.n) is linear in x. Multiplying the bounds
+// tests |(t*d - P).w| < halfWidth (and likewise for the height) through by d.n turns each of
+// them into a pair of linear inequalities in x, so the covered span of each row is found in
+// closed form, and only the depth needs to be stepped across it.
+// Params:
+//	plane						the plane, in camera space
+//	objectIndex					the index of the plane in the scene's object list
+//	startX, endX, startY, endY	the range of pixels that might be covered by the plane
+void Camera::rasterisePlane(const Plane* plane, unsigned objectIndex, unsigned startX, unsigned endX, unsigned startY, unsigned endY)
 {
+	const Vector3D normal = plane->calculateNormal();
+	const Vector3D& widthDir = plane->getWidthDirection();
+	const Vector3D& heightDir = plane->getHeightDirection();
+	const Vector3D centre = plane->position().asVector();
+	const double centreDotNormal = centre.dot(normal),
+		centreDotWidth = centre.dot(widthDir),
+		centreDotHeight = centre.dot(heightDir);
+
+	// A plane through the camera is seen edge on, and can't be hit at a positive distance
+	if (centreDotNormal == 0.0)
+		return;
+
+	// Multiplying through by sign(P.n) * d.n, which is positive wherever t is
+	const double sign = centreDotNormal > 0.0 ? 1.0 : -1.0, absCentreDotNormal = fabs(centreDotNormal);
+	const double halfWidth = plane->getHalfWidth(), halfHeight = plane->getHalfHeight();
+	const double d = m_viewPlane.distance, pixelWidth = m_pixelWidth;
+
+	const unsigned rectWidth = endX - startX;
+	if (m_validateRasterisation)
+		m_rasterDepths.assign(rectWidth * (endY - startY), FLT_MAX);
+
+	for (unsigned j = startY; j < endY; ++j)
+	{
+		// Each dot product with the ray is linear in x: d.v = x * v.x + (y * v.y + distance * v.z)
+		const double y = static_cast<double>(j) * m_pixelHeight - m_viewPlane.halfHeight;
+		const double rayDotNormal = y * normal.y + d * normal.z,
+			rayDotWidth = y * widthDir.y + d * widthDir.z,
+			rayDotHeight = y * heightDir.y + d * heightDir.z;
+
+		// Linear constraints g*x + h > 0, where s = sign(P.n):
+		//	t > 0:					s * d.n > 0
+		//	u < halfWidth:			s * (halfWidth + P.w) * d.n - |P.n| * d.w > 0
+		//	u > -halfWidth:			s * (halfWidth - P.w) * d.n + |P.n| * d.w > 0
+		// and the same for the height direction
+		double spanStart = -DBL_MAX, spanEnd = DBL_MAX;
+		const double widthPlus = sign * (halfWidth + centreDotWidth), widthMinus = sign * (halfWidth - centreDotWidth),
+			heightPlus = sign * (halfHeight + centreDotHeight), heightMinus = sign * (halfHeight - centreDotHeight);
+		if (!clipToHalfLine(sign * normal.x, sign * rayDotNormal, spanStart, spanEnd)
+			|| !clipToHalfLine(widthPlus * normal.x - absCentreDotNormal * widthDir.x,
+				widthPlus * rayDotNormal - absCentreDotNormal * rayDotWidth, spanStart, spanEnd)
+			|| !clipToHalfLine(widthMinus * normal.x + absCentreDotNormal * widthDir.x,
+				widthMinus * rayDotNormal + absCentreDotNormal * rayDotWidth, spanStart, spanEnd)
+			|| !clipToHalfLine(heightPlus * normal.x - absCentreDotNormal * heightDir.x,
+				heightPlus * rayDotNormal - absCentreDotNormal * rayDotHeight, spanStart, spanEnd)
+			|| !clipToHalfLine(heightMinus * normal.x + absCentreDotNormal * heightDir.x,
+				heightMinus * rayDotNormal + absCentreDotNormal * rayDotHeight, spanStart, spanEnd))
+			continue;
+
+		// Convert the span to pixel indices, where pixel i has x = i * pixelWidth - halfWidth
+		const double first = ceil((spanStart + m_viewPlane.halfWidth) / pixelWidth),
+			last = floor((spanEnd + m_viewPlane.halfWidth) / pixelWidth) + 1.0;
+		const unsigned pixelStart = static_cast<unsigned>(max(first, static_cast<double>(startX))),
+			pixelEnd = static_cast<unsigned>(min(last, static_cast<double>(endX)));
+		if (pixelStart >= pixelEnd)
+			continue;
+
+		// Starting values and steps for 1/t and |d|^2
+		const double x = static_cast<double>(pixelStart) * pixelWidth - m_viewPlane.halfWidth;
+		double invT = (x * normal.x + rayDotNormal) / centreDotNormal;
+		const double invTStep = normal.x * pixelWidth / centreDotNormal;
+		double length2 = x * x + y * y + d * d, lengthStep = 2.0 * x * pixelWidth + pixelWidth * pixelWidth;
+		const double lengthStep2 = 2.0 * pixelWidth * pixelWidth;
+
+		for (unsigned i = pixelStart; i < pixelEnd; ++i)
+		{
+			// Distance along the normalised ray is t * |d|
+			const float distToIntersection = static_cast<float>(sqrt(length2) / invT);
+			if (distToIntersection < m_pixelBuf.getDepth(i, j))
+				m_pixelBuf.setPixel(i, j, objectIndex, distToIntersection);
 
-	//Initialising Matrices for X, Y and Z rotations
-	Matrix3D xRotation = Matrix3D();
-	Matrix3D yRotation = Matrix3D();
-	Matrix3D zRotation = Matrix3D();
-
-	//X Rotation Matrix
-	/*
-			[1 ,  0 ,  0  ]
-	 Rx(0)= [0 ,cos0, sin0]
-			[0 ,-sin0,cos0]
-	*/
-	//Setting X values in xRotation matrix to those in Rx 
-	xRotation(0, 0) = 1;
-	xRotation(1, 1) = cosf(m_rotation.x);
-	xRotation(1, 2) = -sinf(m_rotation.x);
-	xRotation(2, 1) = sinf(m_rotation.x);
-	xRotation(2, 2) = cosf(m_rotation.x);
-
-
-	//Y Rotation Matrix
-	/*
-			[cos0 ,0,-sin0]
-	 Ry(0)= [0 ,   1,  0  ]
-			[sin0, 0 ,cos0]
-	*/
-	yRotation(0, 0) = cosf(m_rotation.y);
-	yRotation(0, 2) = sinf(m_rotation.y);
-	yRotation(1, 1) = 1;
-	yRotation(2, 0) = -sinf(m_rotation.y);
-	yRotation(2, 2) = cosf(m_rotation.y);
-
-
-	//Z Rotation Matrix
-		/*
-				[cos0,sin0, 0 ]
-		 Rz(0)= [-sin,cos0, 0 ]
-				[0 ,   0  , 1 ]
-		*/
-	zRotation(0, 0) = cosf(m_rotation.z);
-	zRotation(0, 1) = sinf(m_rotation.z);
-	zRotation(1, 0) = -sinf(m_rotation.z);
-	zRotation(1, 1) = cosf(m_rotation.z);
-	zRotation(2, 2) = 1;
-
-
-	//Combines all rotations for a final rotation matrix for all axes
-	Matrix3D xyzRotation = xRotation * yRotation * zRotation;
-
-	//Translation matrix
-	Matrix3D xyzTranslation = Matrix3D(); //Initialises translation matrix and fills with identity matrix (1 in diagonals top left to bottom right)
-
-	//In 4x4 Matrices, right most columns store	translations along the X,Y and Z axes respectively:
-	xyzTranslation(0, 3) = m_position.x; 
-	xyzTranslation(1, 3) = m_position.y;
-	xyzTranslation(2, 3) = m_position.z;
-
-	//Element (2,2) Represents scaling factor along Z-axis. (Inverts Q/E controls)
-	xyzTranslation(2, 2) = -1;
-	
-	
-	//combines the transformation and rotation matrices to give a final camera to world transformation that we can apply to our 3D objects.
-	m_cameraToWorldTransform = xyzRotation * xyzTranslation;
-	//m_cameraToWorldTransform = xyzTranslation * xyzRotation;
+			if (m_validateRasterisation)
+				m_rasterDepths[(i - startX) + rectWidth * (j - startY)] = distToIntersection;
+
+			invT += invTStep;
+			length2 += lengthStep;
+			lengthStep += lengthStep2;
+		}
+	}
 
+	if (m_validateRasterisation)
+		validateRasterisation(plane, startX, endX, startY, endY, m_rasterDepths);
 }
 
-void Camera::updateLightTransform()
+// Stores the surface normal of the closest object for each pixel that sees one.
+// This runs after the visibility pass, so the normal is only found once per pixel. Each pixel
+// only writes its own normal, so the rows of tiles are shared out between the threads.
+// Params:
+//	objects		the scene's objects, in camera space
+void Camera::storeNormals(const std::vector<Object*>& objects)
 {
-	// Initialize matrices for X, Y, and Z rotations
-	Matrix3D xRotation = Matrix3D();
-	Matrix3D yRotation = Matrix3D();
-	Matrix3D zRotation = Matrix3D();
-
-	// Set values in xRotation matrix
-	xRotation(0, 0) = 1;
-	xRotation(1, 1) = cosf(m_rotation.x);
-	xRotation(1, 2) = -sinf(m_rotation.x);
-	xRotation(2, 1) = sinf(m_rotation.x);
-	xRotation(2, 2) = cosf(m_rotation.x);
-
-	// Set values in yRotation matrix
-	yRotation(0, 0) = cosf(m_rotation.y);
-	yRotation(0, 2) = sinf(m_rotation.y);
-	yRotation(1, 1) = 1;
-	yRotation(2, 0) = -sinf(m_rotation.y);
-	yRotation(2, 2) = cosf(m_rotation.y);
-
-	// Set values in zRotation matrix
-	zRotation(0, 0) = cosf(m_rotation.z);
-	zRotation(0, 1) = -sinf(m_rotation.z);
-	zRotation(1, 0) = sinf(m_rotation.z);
-	zRotation(1, 1) = cosf(m_rotation.z);
-	zRotation(2, 2) = 1;
-	
-	Matrix3D xyzRotation = xRotation * yRotation * zRotation;
+	parallelFor(m_pixelBuf.tilesY(), 1, [&](unsigned begin, unsigned end)
+	{
+		for (PixelBuffer::Iterator it = m_pixelBuf.beginTile(0, begin), last = m_pixelBuf.beginTile(0, end); it != last; ++it)
+		{
+			const PixelBuffer::Pixel pixel = *it;
+			const unsigned objectIndex = m_pixelBuf.getObjectIndexAt(pixel.index);
+			if (objectIndex == PixelBuffer::c_noObject)
+				continue;
 
-	
+			const Point3D hitPoint = Point3D() + m_rayDirections.getDirection(pixel.i, pixel.j) * m_pixelBuf.getDepthAt(pixel.index);
+			m_pixelBuf.setNormalAt(pixel.index, objects[objectIndex]->getNormalAt(hitPoint));
+		}
+	});
+}
 
-	//Translation matrix
-	Matrix3D xyzTranslation = Matrix3D(); //Initialises translation matrix and fills with identity matrix (1 in diagonals top left to bottom right)
+// Compares rasterised coverage of an object against the ray intersection tests, counting
+// the pixels where only one of the two methods finds an intersection
+// Params:
+//	obj							the object, in camera space
+//	startX, endX, startY, endY	the range of pixels that was rasterised
+//	depths						the rasterised depth for each pixel in the range, or FLT_MAX if not covered
+void Camera::validateRasterisation(const Object* obj, unsigned startX, unsigned endX, unsigned startY, unsigned endY, const std::vector<float>& depths)
+{
+	const Point3D origin;
+	float distToIntersection;
+	const unsigned rectWidth = endX - startX;
+	for (unsigned j = startY; j < endY; ++j)
+	{
+		for (unsigned i = startX; i < endX; ++i)
+		{
+			const bool rayHit = obj->getIntersection(origin, getRayDirectionThroughPixel(i, j), distToIntersection);
+			const bool rasterHit = depths[(i - startX) + rectWidth * (j - startY)] < FLT_MAX;
+			if (rayHit != rasterHit)
+				++m_rasterisationMismatches;
+		}
+	}
+}
 
-	//In 4x4 Matrices, right most columns store	translations along the X,Y and Z axes respectively:
-	xyzTranslation(0, 3) = m_position.x;
-	xyzTranslation(1, 3) = m_position.y;
-	xyzTranslation(2, 3) = m_position.z;
+// Finds the range of pixels that might be covered by a sphere in camera space, by projecting the
+// corners of its bounding box onto the view plane. Returns false if no pixels are covered.
+// Params:
+//	centre, radius				the camera space bounding sphere (input)
+//	startX, endX, startY, endY	the pixel index range, with end indices one past the last pixel (output)
+bool Camera::getPixelBounds(const Point3D& centre, float radius, unsigned& startX, unsigned& endX, unsigned& startY, unsigned& endY) const
+{
+	const float nearZ = centre.z - radius, farZ = centre.z + radius;
+	float minX = -m_viewPlane.halfWidth, maxX = m_viewPlane.halfWidth,
+		minY = -m_viewPlane.halfHeight, maxY = m_viewPlane.halfHeight;
 
-	//Element (2,2) Represents scaling factor along Z-axis. (Inverts Q/E controls)
-	xyzTranslation(2, 2) = -1;
-	
-	// Multiply the matrices together to get the final transformation matrix
-	
-	m_distantLight.lightToWorld = xyzRotation * xyzTranslation;
+	// If the sphere straddles the near plane its projection is unbounded,
+	// so it might cover the whole view plane
+	if (nearZ > m_frustum.nearDistance())
+	{
+		// The smallest projected x comes from the left edge of the box at whichever depth
+		// makes it furthest left, and similarly for the other edges
+		const float left = centre.x - radius, right = centre.x + radius,
+			bottom = centre.y - radius, top = centre.y + radius;
+		minX = left * m_viewPlane.distance / (left >= 0.0f ? farZ : nearZ);
+		maxX = right * m_viewPlane.distance / (right >= 0.0f ? nearZ : farZ);
+		minY = bottom * m_viewPlane.distance / (bottom >= 0.0f ? farZ : nearZ);
+		maxY = top * m_viewPlane.distance / (top >= 0.0f ? nearZ : farZ);
+	}
 
+	// Convert to pixel indices, clamping before the conversion to int so huge values can't overflow
+	const float resX = static_cast<float>(m_viewPlane.resolutionX), resY = static_cast<float>(m_viewPlane.resolutionY);
+	const int firstX = static_cast<int>(clamp((minX + m_viewPlane.halfWidth) / m_pixelWidth, 0.0f, resX)),
+		lastX = static_cast<int>(clamp((maxX + m_viewPlane.halfWidth) / m_pixelWidth + 1.0f, 0.0f, resX)),
+		firstY = static_cast<int>(clamp((minY + m_viewPlane.halfHeight) / m_pixelHeight, 0.0f, resY)),
+		lastY = static_cast<int>(clamp((maxY + m_viewPlane.halfHeight) / m_pixelHeight + 1.0f, 0.0f, resY));
+
+	startX = firstX;
+	endX = lastX;
+	startY = firstY;
+	endY = lastY;
+	return startX < endX && startY < endY;
+}
 
+//--------------------------------------------------------------------------------------------------------------------//
+
+// Gets the normalised direction in camera space of a ray from
+// the camera through the view-plane pixel at index (i, j),
+// where 0 <= i < m_viewPlane.resolutionX and 0 <= j < m_viewPlane.resolutionY.
+// The directions are looked up from m_rayDirections rather than recalculated.
+Vector3D Camera::getRayDirectionThroughPixel(int i, int j)
+{
+	return m_rayDirections.getDirection(i, j);
+}
+
+// Computes the transformation of the camera in world space, which is also the
+// transform that will take objects from camera to world coordinates,
+// and stores it (and its inverse) in m_cameraToWorldTransform.
+void Camera::updateTransforms()
+{
+	// The transform is the rotation Rx * Ry * Rz applied after translating by the camera's
+	// position and flipping the z axis (which inverts the Q/E controls)
+	const EulerSinCos rotation(m_rotation);
+	const Vector3D flipZ(1.0f, 1.0f, -1.0f);
+	m_cameraToWorldTransform.set(AffineMatrix3D::fromEulerRotation(rotation, m_position, flipZ));
 }
 
 //Converts point in world space into camera space coordinates
-Point3D Camera::worldToCameraSpace(Point3D p) {
+Point3D Camera::worldToCameraSpace(const Point3D& p) {
 
 	//Scaling the world point to pixel sizes
 	float scaledX = p.x * m_pixelWidth;
@@ -262,206 +548,371 @@ Point3D Camera::worldToCameraSpace(Point3D p) {
 }
 
 
-// Gets the colour of a given pixel based on the closest object as stored in the pixel buffer
+// Renders the frame and writes the colours out as a linear image ready for presentation:
+// rows run from the top of the view plane to the bottom (so the y-axis is flipped), with
+// resolutionX pixels per row. The frame is drawn into a floating point framebuffer by the
+// Phong shading or the path tracer, then tone mapped into the image in one pass.
 // Params:
-//	i, j	Pixel x, y coordinates
-Colour Camera::getColourAtPixel(unsigned i, unsigned j, std::vector<Object*> m_objects)
+//	scene		the scene's objects (in world space), materials and lights
+//	image		resolutionX * resolutionY colours (output)
+void Camera::renderImage(const Scene& scene, std::vector<Colour>& image)
 {
-	Colour colour;
-	
-	// You can use the object information stored in m_pixelBuf
-	// for the object and its intersection; if you want to add more information
-	// from the intersection test, you'll need to:
-	// 1. calculate and pass the values back from Object::getIntersection() (and the derived class overrides)
-	// 2. update the ObjectInfo struct in PixelBuffer.h to store the appropriate value types
-	// 3. update the marked section in updatePixelBuffer() to store the values in m_pixelBuf
+	m_frame.resize(m_viewPlane.resolutionX, m_viewPlane.resolutionY);
+	if (m_pathTracing)
+	{
+		PathTracerView view;
+		view.cameraToWorld = m_cameraToWorldTransform.matrix();
+		view.distance = m_viewPlane.distance;
+		view.halfWidth = m_viewPlane.halfWidth;
+		view.halfHeight = m_viewPlane.halfHeight;
+		view.resolutionX = m_viewPlane.resolutionX;
+		view.resolutionY = m_viewPlane.resolutionY;
+		m_intersector.build(scene.objects);
+		m_pathTracer.render(view, scene, m_intersector, m_frame);
+	}
+	else
+		shadeFrame(scene);
 
+	// Groups of four pixels are resolved together, so share the groups between the threads
+	image.resize(m_frame.size());
+	parallelFor((m_frame.size() + 3) / 4, 1024, [&](unsigned begin, unsigned end)
+	{
+		m_frame.resolve(m_toneMap, image, begin * 4, end * 4);
+	});
+}
 
-	const ObjectInfo& objInfo = m_pixelBuf.getObjectInfoForPixel(i, j);
+// Shades every pixel with the Phong model into the framebuffer, sharing the tiles out between the
+// thread pool's threads (or with the wavefront renderer). Each tile is only shaded with the lights
+// that can reach it.
+// Params:
+//	scene		the scene's objects (in world space), materials and lights
+void Camera::shadeFrame(const Scene& scene)
+{
+	m_shading.prepare(scene.lights, m_cameraToWorldTransform.inverse());
+	m_tileLights.build(m_pixelBuf, m_rayDirections, m_shading);
+
+	const bool shadows = m_shadowMode != ShadowMode::None;
+	if (shadows)
+		m_intersector.build(scene.objects);
+	m_shadowRayCount = 0;
 
-	const Object* object = objInfo.object;
-	if (object != nullptr)
+	// The shadow map covers the first directional light; it is only rebuilt when the light or objects change
+	m_shadowMapLight = c_noShadowMapLight;
+	if (m_shadowMode == ShadowMode::Map)
 	{
-		//Point3D hitPoint = objInfo.intersectionPoint;
-		Vector3D rayDir = getRayDirectionThroughPixel(i, j);
-		Vector3D hitNormal;
-		Point3D origin = m_position;
+		for (unsigned l = 0; l < scene.lights.size() && m_shadowMapLight == c_noShadowMapLight; ++l)
+		{
+			if (scene.lights.type(l) == LightSource::Type::Directional)
+				m_shadowMapLight = l;
+		}
+		if (m_shadowMapLight != c_noShadowMapLight)
+			m_shadowMap.update(scene.lights.direction(m_shadowMapLight), m_intersector);
+	}
 
-		//bool intersection = object->getIntersection(objInfo.object->intersectionPoint, rayDir);
+	// Reflected surfaces can be lit by any light, so they are shaded without culling
+	m_allLights.resize(m_shading.numLights);
+	for (unsigned l = 0; l < m_shading.numLights; ++l)
+		m_allLights[l] = l;
+	const bool reflections = m_maxReflectionDepth > 0;
+	if (reflections && !shadows)
+		m_intersector.build(scene.objects);
+	m_reflectionRayCount = 0;
 
-		//hitColor = object.albedo / M_PI * light->intensity * light->color * std::max(0, hitNormal.dot(L));
+	if (m_wavefront)
+	{
+		WavefrontFrame frame;
+		frame.scene = &scene;
+		frame.pixels = &m_pixelBuf;
+		frame.rayDirections = &m_rayDirections;
+		frame.shading = &m_shading;
+		frame.tileLights = &m_tileLights;
+		frame.allLights = m_allLights.data();
+		frame.intersector = &m_intersector;
+		frame.cameraToWorld = &m_cameraToWorldTransform;
+		frame.shadows = shadows;
+		frame.shadowMap = &m_shadowMap;
+		frame.shadowMapLight = m_shadowMapLight;
+		frame.maxReflectionDepth = m_maxReflectionDepth;
+		frame.secondaryRayBudget = m_secondaryRayBudget;
+		frame.sortSecondaryRays = m_sortSecondaryRays;
+		m_wavefrontRenderer.render(frame, m_frame);
+		m_shadowRayCount = m_wavefrontRenderer.getStats().shadowRays;
+		m_reflectionRayCount = m_wavefrontRenderer.getStats().reflectionRays;
+		return;
+	}
 
-		colour = object->m_colour;
-		colour = Phong(object, colour, origin, rayDir, &m_distantLight);
+	// Each of the pool's threads shades its tiles with its own scratch space, which is only made when
+	// the number of threads changes
+	ThreadPool* pool = ThreadPool::current();
+	const unsigned numThreads = pool != nullptr ? pool->getNumThreads() : 1;
+	if (m_tileScratch.size() != numThreads)
+	{
+		m_tileScratch = std::vector<TileScratch>(numThreads);
+		for (TileScratch& scratch : m_tileScratch)
+		{
+			scratch.reflectionRays.reserve(PixelBuffer::c_pixelsPerTile);
+			scratch.nextReflectionRays.reserve(PixelBuffer::c_pixelsPerTile);
+		}
+	}
+	for (TileScratch& scratch : m_tileScratch)
+	{
+		scratch.shadowRayCount = 0;
+		scratch.reflectionRayCount = 0;
 	}
-	return colour;
-	
-}
 
-Vector3D  ColourToVector(Colour c) {
-	return Vector3D(c.r, c.b, c.g);
-}
-Colour VectorToColour(Vector3D v) {
-	return Colour(v.x, v.y, v.z);
-}
+	// Every tile gets an equal share of the secondary ray budget, so the rays traced don't depend
+	// on which order the threads reach the tiles in
+	const unsigned tilesX = m_pixelBuf.tilesX(), numTiles = tilesX * m_pixelBuf.tilesY();
+	const unsigned tileBudget = reflections ? m_secondaryRayBudget / numTiles : 0;
+	const unsigned budgetRemainder = reflections ? m_secondaryRayBudget % numTiles : 0;
+	parallelFor(numTiles, 4, [&](unsigned begin, unsigned end)
+	{
+		TileScratch& scratch = m_tileScratch[ThreadPool::getThreadIndex()];
+		for (unsigned tile = begin; tile < end; ++tile)
+		{
+			scratch.reflectionRaysLeft = tileBudget + (tile < budgetRemainder ? 1 : 0);
+			shadeTile(tile % tilesX, tile / tilesX, scene, scratch);
+		}
+	});
 
-float clamp(float input, float lb, float ub){ 
-	//return (input < lb) ? lb : ((input > ub) ? ub : input); 
-	if (input < lb) { return lb; }
-	else if (input > ub) { return ub; }
-	else return input;
+	for (const TileScratch& scratch : m_tileScratch)
+	{
+		m_shadowRayCount += scratch.shadowRayCount;
+		m_reflectionRayCount += scratch.reflectionRayCount;
+	}
 }
 
-//Calculates the refelection vector of a given incident ray, using surface normals
-Vector3D Camera::getReflectionVector(Vector3D& U, Vector3D& N) {
-	
-	//Using the reflection Formula:
-	// Reflected Ray Vector = Incident Ray Vector - 2*(Incident Dot Normal)*Normal
-	// R = U - 2(U .DOT. N)N
-	// R: the final reflected vector
-	// U: The incident ray (vector being refelcted)
-	// N: Surface normal (found using object helper functions for sphere/plane)
+// Shades one tile's pixels into the framebuffer, with the lights that can reach the tile, then
+// traces their shadow and reflection rays. Tiles can be shaded on several threads at once, each
+// with its own scratch space. Params:
+//	tileX, tileY	the tile's indices
+//	scene			the scene's objects (in world space), materials and lights
+//	scratch			the calling thread's scratch space, with the tile's share of the ray budget set
+void Camera::shadeTile(unsigned tileX, unsigned tileY, const Scene& scene, TileScratch& scratch)
+{
+	const unsigned lastRow = m_viewPlane.resolutionY - 1;
+	const bool shadows = m_shadowMode != ShadowMode::None;
+	const bool reflections = m_maxReflectionDepth > 0;
+
+	const unsigned* lights = m_tileLights.getLights(tileX, tileY);
+	const unsigned numLights = m_tileLights.getNumLights(tileX, tileY);
+	if (shadows)
+		traceTileShadows(tileX, tileY, lights, numLights, scene, scratch);
+
+	// The occlusion flags are in the same order as the pixels with objects
+	const unsigned char* occluded = shadows ? scratch.occluded.data() : nullptr;
+	unsigned slot = 0;
+	scratch.reflectionRays.clear();
+	for (PixelBuffer::Iterator it = m_pixelBuf.beginTile(tileX, tileY), end = m_pixelBuf.endTile(tileX, tileY); it != end; ++it, ++slot)
+	{
+		const PixelBuffer::Pixel pixel = *it;
+		scratch.imageIndices[slot] = pixel.i + m_viewPlane.resolutionX * (lastRow - pixel.j);
+		scratch.colours[slot] = Vector3D();
+
+		const unsigned objectIndex = m_pixelBuf.getObjectIndexAt(pixel.index);
+		if (objectIndex == PixelBuffer::c_noObject)
+			continue;
+
+		// Surfaces are shaded from the side the viewer sees, like reflected hits and the
+		// wavefront renderer, and the reflection leaves from the same point and normal
+		const Vector3D rayDir = m_rayDirections.getDirection(pixel.i, pixel.j);
+		Vector3D normal = getNormalAtPixel(pixel, rayDir, scene);
+		if (normal.dot(rayDir) > 0.0f)
+			normal = normal * -1;
+		scratch.colours[slot] = shadePixel(pixel, rayDir, normal, lights, numLights, occluded, scene);
+		if (occluded != nullptr)
+			occluded += numLights;
+
+		const float reflectivity = scene.materials.reflectivity(scene.objects[objectIndex]->m_material);
+		if (reflections && reflectivity > 0.0f && scratch.reflectionRaysLeft > 0)
+			queueReflection(pixel, slot, reflectivity, rayDir, normal, scratch);
+	}
 
-	Vector3D R = U - (2 * N * (U.dot(N)));
-	return R;
+	if (scratch.reflectionRays.count > 0)
+		traceTileReflections(scene, scratch);
 
+	for (unsigned k = 0; k < slot; ++k)
+		m_frame.set(scratch.imageIndices[k], scratch.colours[k]);
 }
 
-Colour Camera::Phong(const Object* object, Colour colour, Point3D raySrc, Vector3D rayDir, DistantLight* light) {
-	
-	//Casts the shape classes onto the object to see what type of object is actually is, will return nullptr if not that object
-	const Sphere* sphere = dynamic_cast<const Sphere*>(object);
-	const Plane* plane = dynamic_cast<const Plane*>(object);
+// Finds which of the tile's lights are blocked for each of its pixels, by tracing a shadow ray
+// from each pixel's surface point towards each light. The rays for the whole tile are queued
+// up first, moved to world space together, and then traced, stopping each one at the first
+// object found. Surfaces facing away from a light are in their own shadow, so need no ray.
+// The light covered by the shadow map (if any) is looked up in the map instead.
+// Params:
+//	tileX, tileY	the tile's indices
+//	lights			indices of the lights that reach the tile
+//	numLights		number of light indices
+//	scene			the scene's objects, in world space
+//	scratch			the calling thread's scratch space, which gets the tile's occlusion flags
+void Camera::traceTileShadows(unsigned tileX, unsigned tileY, const unsigned* lights, unsigned numLights, const Scene& scene, TileScratch& scratch) const
+{
+	scratch.shadowRays.clear();
+	scratch.shadowRayLights.clear();
+	scratch.occluded.resize(PixelBuffer::c_pixelsPerTile * numLights);
 
+	const AffineMatrix3D& cameraToWorld = m_cameraToWorldTransform.matrix();
+	unsigned entry = 0;
+	for (PixelBuffer::Iterator it = m_pixelBuf.beginTile(tileX, tileY), end = m_pixelBuf.endTile(tileX, tileY); it != end; ++it)
+	{
+		const PixelBuffer::Pixel pixel = *it;
+		if (m_pixelBuf.getObjectIndexAt(pixel.index) == PixelBuffer::c_noObject)
+			continue;
+
+		const Vector3D rayDir = m_rayDirections.getDirection(pixel.i, pixel.j);
+		const Point3D hitPoint = Point3D() + rayDir * m_pixelBuf.getDepthAt(pixel.index);
+		Vector3D normal = getNormalAtPixel(pixel, rayDir, scene);
+		if (normal.dot(rayDir) > 0.0f)
+			normal = normal * -1;
+		const Point3D origin = hitPoint + normal * c_rayBias;
+
+		for (unsigned k = 0; k < numLights; ++k, ++entry)
+		{
+			const unsigned l = lights[k];
+			Vector3D toLight(m_shading.x[l], m_shading.y[l], m_shading.z[l]);
+			float distance = FLT_MAX;
+			if (m_shading.isPoint[l])
+			{
+				toLight = toLight - origin.asVector();
+				distance = toLight.magnitude();
+				toLight = toLight * (1.0f / distance);
+			}
 
-	//Phong Shading Values:
-	Vector3D diffuse=0, specular, ambient;
-	Vector3D objectColourVector = ColourToVector(colour); //We need to convert the colour object to a vector so that we can include it in our maths
+			scratch.occluded[entry] = 1;
+			if (normal.dot(toLight) <= 0.0f)
+				continue;
 
-	float distToIntersection;
-	if (sphere != nullptr) { //If sphere doesn't return a null pointer when cast onto object (i.e it IS a sphere)
-		distToIntersection = sphere->getDistToIntersection(raySrc, rayDir);
-	}
-	if (plane != nullptr) { //If plane doesn't return a null pointer when cast onto object (i.e it IS a plane)
-		distToIntersection = plane->getDistToIntersection(raySrc, rayDir);
+			if (l == m_shadowMapLight)
+				scratch.occluded[entry] = m_shadowMap.isOccluded(cameraToWorld * origin) ? 1 : 0;
+			else
+			{
+				scratch.shadowRays.add(origin, toLight, distance);
+				scratch.shadowRayLights.push_back(entry);
+			}
+		}
 	}
 
-	// get the current object and distance to its intersection
-	//TODO: fix null warning
-	//object->getIntersection(raySrc, rayDir, distToIntersection);
+	// The objects are in world space by now, so take the rays there too
+	cameraToWorld.transformPoints(scratch.shadowRays.origins, scratch.shadowRays.origins);
+	cameraToWorld.transformVectors(scratch.shadowRays.directions, scratch.shadowRays.directions);
+	m_intersector.traceOcclusion(scratch.shadowRays);
 
+	for (unsigned r = 0; r < scratch.shadowRays.count; ++r)
+		scratch.occluded[scratch.shadowRayLights[r]] = scratch.shadowRays.occluded[r];
+	scratch.shadowRayCount += scratch.shadowRays.count;
+}
 
-	Point3D intersectionPoint;
-	Vector3D lightDirection;
-	Vector3D intersectionToLight;
-	Vector3D lightIntensity, reflectionVector, lightColourVector;
-	Vector3D normal;
+// Queues the mirror reflection of a pixel's camera ray, and scales down the pixel's own
+// colour to make room for what the ray finds.
+// Params:
+//	pixel			the pixel's coordinates and storage index
+//	slot			the pixel's position within its tile
+//	reflectivity	fraction of the pixel's colour that comes from the reflection
+//	rayDir			the camera space direction of the pixel's ray
+//	normal			the surface normal the pixel was shaded with, facing the viewer
+//	scratch			the calling thread's scratch space, which holds the tile's rays and colours
+void Camera::queueReflection(const PixelBuffer::Pixel& pixel, unsigned slot, float reflectivity, const Vector3D& rayDir, const Vector3D& normal, TileScratch& scratch) const
+{
+	const float cosine = normal.dot(rayDir);
+	const Point3D hitPoint = Point3D() + rayDir * m_pixelBuf.getDepthAt(pixel.index);
+	scratch.reflectionRays.add(hitPoint + normal * c_rayBias, rayDir - normal * (2.0f * cosine), slot, reflectivity);
+	scratch.colours[slot] = scratch.colours[slot] * (1.0f - reflectivity);
+	--scratch.reflectionRaysLeft;
+	++scratch.reflectionRayCount;
+}
 
-	//Calculates point of intersection using:
-	//Intersection = Origin + |Distance| dot(RayDirection) 
-	//or I = O + |D|R
-	float distMag = abs(distToIntersection);
-	intersectionPoint = raySrc + distMag * rayDir;
+// Traces the tile's queued reflection rays one bounce at a time, rather than recursively: every
+// ray of a bounce is traced as one batch, and the rays reflected from reflective surfaces are
+// queued for the next batch, until there are none left or the maximum depth is reached. Each
+// surface found adds its Phong colour, weighted by the product of the reflectivities along the
+// way, to the pixel the ray came from. Reflected surfaces are lit by every light, without shadows.
+// Params:
+//	scene		the scene's objects (in world space), materials and lights
+//	scratch		the calling thread's scratch space, which holds the tile's rays and colours
+void Camera::traceTileReflections(const Scene& scene, TileScratch& scratch) const
+{
+	// The first bounce starts from the camera space pixel buffer, but the objects are in world space
+	const AffineMatrix3D& cameraToWorld = m_cameraToWorldTransform.matrix();
+	const AffineMatrix3D& worldToCamera = m_cameraToWorldTransform.inverse();
+	cameraToWorld.transformPoints(scratch.reflectionRays.origins, scratch.reflectionRays.origins);
+	cameraToWorld.transformVectors(scratch.reflectionRays.directions, scratch.reflectionRays.directions);
 
+	for (unsigned depth = 1; scratch.reflectionRays.count > 0; ++depth)
+	{
+		m_intersector.traceClosest(scratch.reflectionRays);
+		scratch.nextReflectionRays.clear();
 
-	//Calculating Normal Vectors:
-	if (sphere != nullptr) { //If sphere doesn't return a null pointer when cast onto object (i.e it IS a sphere)
-		normal = sphere->calculateNormal(intersectionPoint);
-		normal.normalise();
-	}
-	if (plane != nullptr) { //If plane doesn't return a null pointer when cast onto object (i.e it IS a plane)
-		normal = plane->calculateNormal();
-		normal.normalise();
-	}
+		for (unsigned r = 0; r < scratch.reflectionRays.count; ++r)
+		{
+			const unsigned objectIndex = scratch.reflectionRays.hitObjects[r];
+			if (objectIndex == SecondaryRays::c_noHit)
+				continue;
+
+			const Object* object = scene.objects[objectIndex];
+			const Vector3D rayDir = scratch.reflectionRays.directions.getVector(r);
+			const Point3D hitPoint = scratch.reflectionRays.origins.getPoint(r) + rayDir * scratch.reflectionRays.hitDistances[r];
+			Vector3D normal = object->getNormalAt(hitPoint);
+			float cosine = normal.dot(rayDir);
+			if (cosine > 0.0f)
+			{
+				normal = normal * -1;
+				cosine = -cosine;
+			}
 
-	//Calculates Light Direction Vector using:
-	//LightDirection = IntersectionPoint - LightPosition
-	//or L = I - P.
-	// I: Point where ray intersects with object in scene
-	// P: current Light's position value.
-	// L: Resulting vector representing direction of Light ray
-	lightDirection = (light->direction)*-1;
-	lightDirection.normalise(); //normalised so that we can apply it to our final light vector
-
-	//Finds vector pointing from the point of intersection to the light source using:
-	//LightVector = LightPosition-IntersectionPoint
-	//or L = P - I
-	//Resulting vector representing the intersection to light vector
-	//intersectionToLight = lights[l]->position() - intersectionPoint;
-	//intersectionToLight.normalise();
-
-	//Calculating Reflection Rays of current light:
-	reflectionVector = getReflectionVector(lightDirection, normal);
-	reflectionVector.normalise();
-
-	//Calculating raySrc (origin) to camera vector
-	//C = O - I
-	//Using vector rules Camera = Origin - Intersection
-	Vector3D srcToCam = raySrc - intersectionPoint;
-	srcToCam.normalise();
-
-	//Gets current light colour and converts to vector format (rgb = xyz)
-	lightColourVector = ColourToVector(light->colour);
-
-
-	//Diffuse Light is calculated using:
-	//Diffuse = id * kd * (L DOT N)
-	//Where:
-	//id: diffuse intensity 
-	//kd: diffuse reflection constant
-	//L: Eye to Light Vector
-	//N: Surface Normal Vector
-	float globalDiffuseReflection = 0.3f;
-	float diffuseCoeffecient = max(0.0f, normal.dot(lightDirection));
-	//diffuse = diffuse + lightColourVector * lights[l]->ambientIntensity * abs(normal.dot(intersectionToLight)) * globalDiffuseReflection;
-	diffuse = lightColourVector * light->intensity * diffuseCoeffecient;// *globalDiffuseReflection;
-
-
-	//Specular Light is calculated using:
-	// Specular = is * ks * (R DOT V)^n  * LightColour
-	//Where:
-	//is: specular intensity (in our simplified model we will use our ambient intensity value for all lights)
-	//ks: specular reflection constant (we can ignore this term if we want uniform materials/reflections)
-	//R: Reflected Vector 
-	//V: origin to camera vector
-	//N: the shininess exponent, controlling the size of the specular highlights
-	//LightColour: colour of the light
-	float globalSpecularReflection = 0.8f; 
-	int shinyExp = 10;
-	float specularInensity = light->intensity * 10;
-	//specular = (specular + lights[l]->ambientIntensity * globalSpecularReflection * pow((reflectionVector.dot(srcToCam)), shinyExp) * lightColourVector);// *specScale;
-	//specular = (lights[l]->ambientIntensity * globalSpecularReflection * pow((reflectionVector.dot(srcToCam)), shinyExp) * lightColourVector);// *specScale;
-	float specularCoefficient = pow(max(0.0f,reflectionVector.dot(srcToCam)), shinyExp);
-	specular = lightColourVector * specularInensity * specularCoefficient;
-	//specular = light->intensity * globalSpecularReflection * pow((reflectionVector.dot(srcToCam)), shinyExp) * lightColourVector;// *specScale;
-
-	//Ambient Light is calculated as:
-	//Ambient = lightColour * ka * ia
-	//Where:
-	//ka: Ambient Reflection constant
-	//ia: Amient intensity.
-	float ka = 0.18f;
-	//ambient = ambient + lightColourVector * lights[l]->ambientIntensity * ka;
-	ambient = lightColourVector * light->intensity * ka;
+			// Shading is done in camera space, like the primary hits
+			Vector3D colour = shadePhong(m_shading, m_allLights.data(), m_shading.numLights, nullptr, scene.materials, object->m_material,
+				worldToCamera * hitPoint, worldToCamera * normal, worldToCamera * (rayDir * -1));
 
+			const float weight = scratch.reflectionRays.weights[r];
+			const float reflectivity = scene.materials.reflectivity(object->m_material);
+			if (reflectivity > 0.0f && depth < m_maxReflectionDepth && scratch.reflectionRaysLeft > 0)
+			{
+				scratch.nextReflectionRays.add(hitPoint + normal * c_rayBias, rayDir - normal * (2.0f * cosine), scratch.reflectionRays.pixels[r], weight * reflectivity);
+				colour = colour * (1.0f - reflectivity);
+				--scratch.reflectionRaysLeft;
+				++scratch.reflectionRayCount;
+			}
 
-	
-	
-	Vector3D phong = diffuse+specular + ambient;
-	
-	// combines the shading effects with the original color, ensuring that the resulting color values are in the normalized range 0-1.
-	//The division by 255 is used to bring the intensity values back to a valid color range if they have been scaled during the shading calculations.
-	objectColourVector = Vector3D(phong.x * objectColourVector.x / 255.0f, phong.y * objectColourVector.y / 255.0f, phong.z * objectColourVector.z / 255.0f);
-
-	//Clamping values within RGB Range (hopefully stops plane phasing out of existence?)
-	//objectColourVector.x = std::clamp()
-	objectColourVector.x = clamp(objectColourVector.x, 0, 255);
-	objectColourVector.y = clamp(objectColourVector.y, 0, 255);
-	objectColourVector.z = clamp(objectColourVector.z, 0, 255);
-	
-	return VectorToColour(objectColourVector);
+			const unsigned slot = scratch.reflectionRays.pixels[r];
+			scratch.colours[slot] = scratch.colours[slot] + colour * weight;
+		}
+
+		std::swap(scratch.reflectionRays, scratch.nextReflectionRays);
+	}
+}
 
+// Gets the camera space surface normal of the closest object for a pixel that sees one.
+// Params:
+//	pixel		the pixel's coordinates and storage index
+//	rayDir		the direction of the ray through the pixel
+//	scene		the scene's objects, in world space
+Vector3D Camera::getNormalAtPixel(const PixelBuffer::Pixel& pixel, const Vector3D& rayDir, const Scene& scene) const
+{
+	if (m_pixelBuf.hasNormals())
+		return m_pixelBuf.getNormalAt(pixel.index);
+
+	// The objects are back in world space, so take the hit point there to find the normal
+	const Object* object = scene.objects[m_pixelBuf.getObjectIndexAt(pixel.index)];
+	const Point3D worldHitPoint = m_cameraToWorldTransform.matrix() * (Point3D() + rayDir * m_pixelBuf.getDepthAt(pixel.index));
+	return m_cameraToWorldTransform.inverse() * object->getNormalAt(worldHitPoint);
+}
 
-	//	return colour;
+// Shades a pixel that sees an object, using the closest object as stored in the pixel buffer.
+// Shading is done in camera space, where the camera is at the origin, so the direction
+// towards the viewer is just the reversed ray direction.
+// Params:
+//	pixel		the pixel's coordinates and storage index
+//	rayDir		the camera space direction of the pixel's ray
+//	normal		the surface normal at the pixel, facing the viewer
+//	lights		indices of the lights to shade the pixel with
+//	numLights	number of light indices
+//	occluded	one flag per light index, 1 if the light is blocked; null for no shadows
+//	scene		the scene's objects (in world space), materials and lights
+Vector3D Camera::shadePixel(const PixelBuffer::Pixel& pixel, const Vector3D& rayDir, const Vector3D& normal, const unsigned* lights, unsigned numLights, const unsigned char* occluded, const Scene& scene) const
+{
+	const Object* object = scene.objects[m_pixelBuf.getObjectIndexAt(pixel.index)];
+	const Point3D hitPoint = Point3D() + rayDir * m_pixelBuf.getDepthAt(pixel.index);
+	return shadePhong(m_shading, lights, numLights, occluded, scene.materials, object->m_material, hitPoint, normal, rayDir * -1);
 }
 
@@ -1,31 +1,58 @@
 #pragma once
-#include "Matrix3D.h"
+#include "AffineMatrix3D.h"
 #include "PixelBuffer.h"
 #include "Object.h"
-
-struct DistantLight {
-	float intensity = 0.8f;
-	//252, 165, 15)
-	Colour colour = Colour(255,255,255);
-	Matrix3D lightToWorld = Matrix3D();
-	Vector3D direction = lightToWorld * Vector3D(0, -1, 0);
-
-	void updateDirection() {
-		direction = lightToWorld * direction;
-		//direction.normalise();
-	}
-};
-
+#include "Frustum.h"
+#include "RayDirectionTable.h"
+#include "ObjectTransformBatch.h"
+#include "Shading.h"
+#include "Scene.h"
+#include "LightCulling.h"
+#include "SceneIntersector.h"
+#include "ShadowMap.h"
+#include "WavefrontRenderer.h"
+#include "PathTracer.h"
+#include "HdrFramebuffer.h"
 
 class Camera
 {
 public:
+	// Methods of finding the closest object to each pixel
+	enum class VisibilityMode
+	{
+		RayCast,	// Test the ray through every pixel in each object's bounding rectangle
+		Rasterise,	// Find the pixels covered by spheres and planes analytically, one scanline at a time
+	};
+
+	// Methods of finding which lights are blocked
+	enum class ShadowMode
+	{
+		None,		// Every light reaches every surface facing it
+		Rays,		// Trace a ray from each shaded point towards each of its lights
+		Map,		// Look the first directional light up in a cached shadow map, and trace rays for the rest
+	};
+
 	void init(const Point3D& pos);
 	bool updatePixelBuffer(const std::vector<Object*>& objects);
 
 	unsigned	getViewPlaneResolutionX() const { return m_viewPlane.resolutionX; }
 	unsigned	getViewPlaneResolutionY() const { return m_viewPlane.resolutionY; }
 
+	// Number of objects culled by the view frustum on the last call to updatePixelBuffer()
+	const CullingStats&	getCullingStats() const { return m_cullingStats; }
+
+	// Choose how primary visibility is found
+	VisibilityMode	getVisibilityMode() const { return m_visibilityMode; }
+	void			setVisibilityMode(VisibilityMode mode) { m_visibilityMode = mode; }
+
+	// When enabled, rasterised pixels are checked against the ray intersection tests, and
+	// the number of pixels where the two disagree is counted on each frame
+	void		setValidateRasterisation(bool validate) { m_validateRasterisation = validate; }
+	unsigned	getRasterisationMismatches() const { return m_rasterisationMismatches; }
+
+	// When enabled, the surface normal of the closest object is stored for each pixel by updatePixelBuffer()
+	void		setStoreNormals(bool store) { m_storeNormals = store; }
+
 	// Change the camera's world space position
 	void	translateX(float x) { m_position.x += x; m_worldTransformChanged = true; }
 	void	translateY(float y) { m_position.y += y; m_worldTransformChanged = true; }
@@ -37,29 +64,105 @@ public:
 	void	rotateZ(float z) { m_rotation.z += z; m_worldTransformChanged = true; }
 
 	// Change the distance from the camera to the view plane
-	void	zoom(float d) { m_viewPlane.distance += d; m_viewPlane.distance = max(1.0f, m_viewPlane.distance); }
+	void	zoom(float d) { m_viewPlane.distance += d; m_viewPlane.distance = max(1.0f, m_viewPlane.distance); m_viewPlaneChanged = true; }
+
+	// Get or replace the whole pose at once, e.g. to record the camera's path and replay it later
+	const Point3D&	getPosition() const { return m_position; }
+	const Vector3D&	getRotation() const { return m_rotation; }
+	float			getViewPlaneDistance() const { return m_viewPlane.distance; }
+	void			setPose(const Point3D& position, const Vector3D& rotation, float viewPlaneDistance)
+	{
+		// Only flag what actually moved, so a replayed frame does the same work as the recorded one
+		if (position.x != m_position.x || position.y != m_position.y || position.z != m_position.z ||
+			rotation.x != m_rotation.x || rotation.y != m_rotation.y || rotation.z != m_rotation.z)
+		{
+			m_position = position;
+			m_rotation = rotation;
+			m_worldTransformChanged = true;
+		}
+		viewPlaneDistance = max(1.0f, viewPlaneDistance);
+		if (viewPlaneDistance != m_viewPlane.distance)
+		{
+			m_viewPlane.distance = viewPlaneDistance;
+			m_viewPlaneChanged = true;
+		}
+	}
+
+	// Shades the whole view plane into a linear, top-down image
+	void	renderImage(const Scene& scene, std::vector<Colour>& image);
+
+	// Number of lights kept for each tile by the light culling in the last call to renderImage()
+	const LightCullingStats&	getLightCullingStats() const { return m_tileLights.getStats(); }
+
+	// Choose how shadows are found
+	ShadowMode	getShadowMode() const { return m_shadowMode; }
+	void		setShadowMode(ShadowMode mode) { m_shadowMode = mode; }
 
-	//Gets Colour at current pixel
-	Colour	getColourAtPixel(unsigned i, unsigned j, std::vector<Object*> m_objects);
+	// Number of shadow rays traced in the last call to renderImage()
+	unsigned	getShadowRayCount() const { return m_shadowRayCount; }
 
-	Vector3D getReflectionVector(Vector3D& U, Vector3D& N);
+	// The shadow map used by ShadowMode::Map, for changing its resolution and bias
+	ShadowMap&	getShadowMap() { return m_shadowMap; }
 
-	//Handles Diffuse, Specular and Ambient Light calculations
-	Colour Phong(const Object *object, Colour colour, Point3D raySrc, Vector3D rayDir, DistantLight* light);
+	// Number of bounces traced for reflective materials (0 for no reflections)
+	unsigned	getMaxReflectionDepth() const { return m_maxReflectionDepth; }
+	void		setMaxReflectionDepth(unsigned depth) { m_maxReflectionDepth = depth; }
 
-	//Sets up light
-	DistantLight m_distantLight = DistantLight();
+	// Maximum number of reflection rays traced in each call to renderImage(); once it is used up,
+	// reflective surfaces are shaded as if they were not reflective. The tiled path gives each tile
+	// an equal share, so the tiles can be shaded in parallel and still use the same rays on every frame.
+	unsigned	getSecondaryRayBudget() const { return m_secondaryRayBudget; }
+	void		setSecondaryRayBudget(unsigned budget) { m_secondaryRayBudget = budget; }
+
+	// Number of reflection rays traced in the last call to renderImage()
+	unsigned	getReflectionRayCount() const { return m_reflectionRayCount; }
+
+	// When enabled, the wavefront renderer sorts each bounce's reflection rays by direction and origin
+	// before tracing them. The tiled path's batches are at most a tile of rays, too few to be worth sorting.
+	bool		getSortSecondaryRays() const { return m_sortSecondaryRays; }
+	void		setSortSecondaryRays(bool sort) { m_sortSecondaryRays = sort; }
+
+	// When enabled, renderImage() runs the wavefront renderer's stages over the whole frame
+	// instead of shading one tile at a time
+	bool		getWavefront() const { return m_wavefront; }
+	void		setWavefront(bool wavefront) { m_wavefront = wavefront; }
+	const WavefrontStats&	getWavefrontStats() const { return m_wavefrontRenderer.getStats(); }
+
+	// When enabled, renderImage() adds a sample from the progressive path tracer to its
+	// accumulated image instead of shading with the Phong model
+	bool		getPathTracing() const { return m_pathTracing; }
+	// The path tracer's colours are linear light, so switching it on or off also switches sRGB encoding
+	void		setPathTracing(bool pathTracing) { m_pathTracing = pathTracing; m_pathTracer.reset(); m_toneMap.srgb = pathTracing; }
+	PathTracer&	getPathTracer() { return m_pathTracer; }
+
+	// How the floating point frame is converted for display
+	ToneMapSettings&	getToneMapSettings() { return m_toneMap; }
 
 private:
+	struct TileScratch;
+
 	Vector3D	getRayDirectionThroughPixel(int i, int j);
-	void		updateWorldTransform();
-	void 		updateLightTransform();
-	Point3D worldToCameraSpace(Point3D p);
+	bool		getPixelBounds(const Point3D& centre, float radius, unsigned& startX, unsigned& endX, unsigned& startY, unsigned& endY) const;
+	void		castRays(const Object* obj, unsigned objectIndex, unsigned startX, unsigned endX, unsigned startY, unsigned endY);
+	void		rasteriseSphere(const Sphere* sphere, unsigned objectIndex, unsigned startX, unsigned endX, unsigned startY, unsigned endY);
+	void		rasterisePlane(const Plane* plane, unsigned objectIndex, unsigned startX, unsigned endX, unsigned startY, unsigned endY);
+	void		storeNormals(const std::vector<Object*>& objects);
+	Vector3D	getNormalAtPixel(const PixelBuffer::Pixel& pixel, const Vector3D& rayDir, const Scene& scene) const;
+	void		shadeFrame(const Scene& scene);
+	void		shadeTile(unsigned tileX, unsigned tileY, const Scene& scene, TileScratch& scratch);
+	void		traceTileShadows(unsigned tileX, unsigned tileY, const unsigned* lights, unsigned numLights, const Scene& scene, TileScratch& scratch) const;
+	Vector3D	shadePixel(const PixelBuffer::Pixel& pixel, const Vector3D& rayDir, const Vector3D& normal, const unsigned* lights, unsigned numLights, const unsigned char* occluded, const Scene& scene) const;
+	void		queueReflection(const PixelBuffer::Pixel& pixel, unsigned slot, float reflectivity, const Vector3D& rayDir, const Vector3D& normal, TileScratch& scratch) const;
+	void		traceTileReflections(const Scene& scene, TileScratch& scratch) const;
+	void		validateRasterisation(const Object* obj, unsigned startX, unsigned endX, unsigned startY, unsigned endY, const std::vector<float>& depths);
+	void		updateTransforms();
+	Point3D worldToCameraSpace(const Point3D& p);
 	
 	Point3D		m_position = Point3D();			// The position (translation) of the camera in world space
 	Vector3D	m_rotation = Vector3D();		// The Euler rotation of the camera in world space
-	Matrix3D	m_cameraToWorldTransform;		// The matrix representing the camera transfrom in world space
+	AffineTransform	m_cameraToWorldTransform;	// The camera transform in world space, with its inverse (world to camera)
 	bool		m_worldTransformChanged = true;	// Flag indicating whether the camera's world transform has been updated
+	ObjectTransformBatch	m_objectTransforms;	// Moves the objects between world and camera space
 	
 	// Properties describing the view plane (framing of the picture)
 	struct
@@ -69,8 +172,85 @@ private:
 		float halfHeight = 3.0f;	// Half extent of the view plane along the y-axis
 		unsigned resolutionX = 250, resolutionY = 250;	// The number of pixels in the x and y directions
 	}	m_viewPlane;
+	bool		m_viewPlaneChanged = true;		// Flag indicating whether the view plane properties have been updated
+	RayDirectionTable	m_rayDirections;		// Primary ray direction through each pixel, rebuilt when the view plane changes
+
+	// Culling of objects that are behind the camera or outside the view plane
+	Frustum			m_frustum;					// The view volume in camera space
+	BoundingSpheres	m_objectBounds;				// Camera space bounds of each object, refilled on each frame
+	std::vector<unsigned char>	m_objectVisible;	// Flags indicating which objects passed the culling test
+	CullingStats	m_cullingStats;				// Number of objects culled on the last frame
+
+	// Primary visibility
+	VisibilityMode	m_visibilityMode = VisibilityMode::RayCast;
+#ifdef _DEBUG
+	bool			m_validateRasterisation = true;		// Compare rasterised coverage with the ray tests
+#else
+	bool			m_validateRasterisation = false;
+#endif
+	unsigned		m_rasterisationMismatches = 0;		// Number of pixels where the two methods disagreed on the last frame
+	std::vector<float>	m_rasterDepths;					// Scratch space for validating rasterised pixels
+
+	// An object that passed culling, with the pixels it might cover
+	struct VisibleObject
+	{
+		const Object*	object;
+		const Sphere*	sphere;		// The object, if it's a sphere, or nullptr
+		const Plane*	plane;		// The object, if it's a plane, or nullptr
+		unsigned		index;
+		unsigned		startX, endX, startY, endY;
+	};
+	std::vector<VisibleObject>	m_visibleObjects;		// Refilled on each frame
 
 	// Cached info for generating the image
 	PixelBuffer m_pixelBuf;								// Stores information about the closest object to each pixel
+	bool m_storeNormals = true;							// Whether m_pixelBuf should hold the surface normal for each pixel (used for shading)
 	float m_pixelWidth = -1.0f, m_pixelHeight = -1.0f;	// Stores the dimensions of each pixel in camera space units
+
+	// Lighting
+	ShadingContext m_shading;							// The scene's lights in camera space, prepared on each frame
+	TileLightLists m_tileLights;						// The lights that reach each tile of the pixel buffer
+	std::vector<unsigned> m_allLights;					// Every light index, for shading reflected hits without culling
+
+	// Shadows
+	ShadowMode m_shadowMode = ShadowMode::None;
+	SceneIntersector m_intersector;						// Finds the objects hit by secondary rays, in world space
+	unsigned m_shadowRayCount = 0;
+	ShadowMap m_shadowMap;								// Cached shadows of the first directional light
+	unsigned m_shadowMapLight = c_noShadowMapLight;		// Index of the light the shadow map is used for this frame
+	static const unsigned c_noShadowMapLight = 0xFFFFFFFFu;
+
+	// Reflections
+	unsigned m_maxReflectionDepth = 3;
+	unsigned m_secondaryRayBudget = 1 << 18;
+	unsigned m_reflectionRayCount = 0;
+	bool m_sortSecondaryRays = false;
+
+	// Scratch space for shading one tile. The tiles are shaded in parallel, so each of the thread
+	// pool's threads has its own, on its own cache lines.
+	struct alignas(64) TileScratch
+	{
+		Vector3D colours[PixelBuffer::c_pixelsPerTile];			// Colour of each pixel in the tile, in the tile's pixel order
+		unsigned imageIndices[PixelBuffer::c_pixelsPerTile];	// Where each of the tile's pixels goes in the image
+		OcclusionRays shadowRays;
+		std::vector<unsigned> shadowRayLights;					// Index into occluded of each shadow ray
+		std::vector<unsigned char> occluded;					// Whether each light is blocked, for each shaded pixel in the tile
+		SecondaryRays reflectionRays;							// The reflection rays of the current bounce
+		SecondaryRays nextReflectionRays;						// The rays spawned by the current bounce
+		unsigned reflectionRaysLeft = 0;						// What is left of the tile's share of the secondary ray budget
+		unsigned shadowRayCount = 0, reflectionRayCount = 0;	// Rays traced by the thread over the frame
+	};
+	std::vector<TileScratch> m_tileScratch;				// One for each of the thread pool's threads, or just one without a pool
+
+	// Wavefront rendering
+	bool m_wavefront = false;
+	WavefrontRenderer m_wavefrontRenderer;
+
+	// Path tracing
+	bool m_pathTracing = false;
+	PathTracer m_pathTracer;
+
+	// The frame being rendered, before tone mapping
+	HdrFramebuffer m_frame;
+	ToneMapSettings m_toneMap;
 };
\ No newline at end of file
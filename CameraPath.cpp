@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include "CameraPath.h"
+#include <fstream>
+
+namespace
+{
+	const char c_identifier[4] = { 'C', 'P', 'T', 'H' };
+	const unsigned c_version = 3;
+	const unsigned c_valuesPerFrame = 10;
+
+	// Layout of the flags value
+	const unsigned c_animateFlag = 1 << 0;
+	const unsigned c_rasteriseFlag = 1 << 1;
+	const unsigned c_shadowModeShift = 2, c_shadowModeMask = 0x3;
+	const unsigned c_reflectionDepthShift = 4, c_reflectionDepthMask = 0xF;
+	const unsigned c_wavefrontFlag = 1 << 8;
+	const unsigned c_pathTracingFlag = 1 << 9;
+	const unsigned c_sortSecondaryRaysFlag = 1 << 10;
+	const unsigned c_reinhardFlag = 1 << 11;
+	const unsigned c_shadowMapResolutionShift = 12, c_shadowMapResolutionMask = 0xF;
+
+	// Returns the position of the highest set bit, e.g. 9 for 512
+	unsigned highestBit(unsigned x)
+	{
+		unsigned bits = 0;
+		while (x >>= 1)
+			++bits;
+		return bits;
+	}
+
+	// Each value is 32 bits, so the floats and integers can share one array
+	union FileValue
+	{
+		float		f;
+		unsigned	u;
+	};
+}
+
+bool CameraPath::save(const char* filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	const unsigned header[2] = { c_version, size() };
+	file.write(c_identifier, sizeof(c_identifier));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	for (const CameraPose& pose : m_poses)
+	{
+		FileValue values[c_valuesPerFrame];
+		values[0].f = pose.time;
+		values[1].f = pose.position.x;
+		values[2].f = pose.position.y;
+		values[3].f = pose.position.z;
+		values[4].f = pose.rotation.x;
+		values[5].f = pose.rotation.y;
+		values[6].f = pose.rotation.z;
+		values[7].f = pose.viewPlaneDistance;
+		values[8].u = (pose.animate ? c_animateFlag : 0) |
+			(pose.visibilityMode == Camera::VisibilityMode::Rasterise ? c_rasteriseFlag : 0) |
+			(static_cast<unsigned>(pose.shadowMode) & c_shadowModeMask) << c_shadowModeShift |
+			min(pose.maxReflectionDepth, c_reflectionDepthMask) << c_reflectionDepthShift |
+			(pose.wavefront ? c_wavefrontFlag : 0) |
+			(pose.pathTracing ? c_pathTracingFlag : 0) |
+			(pose.sortSecondaryRays ? c_sortSecondaryRaysFlag : 0) |
+			(pose.toneMap == ToneMapSettings::Operator::Reinhard ? c_reinhardFlag : 0) |
+			min(highestBit(pose.shadowMapResolution), c_shadowMapResolutionMask) << c_shadowMapResolutionShift;
+		values[9].f = pose.shadowMapDepthBias;
+		file.write(reinterpret_cast<const char*>(values), sizeof(values));
+	}
+	return file.good();
+}
+
+bool CameraPath::load(const char* filename)
+{
+	m_poses.clear();
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	char identifier[sizeof(c_identifier)];
+	unsigned header[2];
+	file.read(identifier, sizeof(identifier));
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!file || memcmp(identifier, c_identifier, sizeof(identifier)) != 0 || header[0] != c_version)
+		return false;
+
+	// Check the frame count against what is left of the file before making room for the frames,
+	// so a truncated or corrupt file can't ask for more memory than it could fill
+	const std::streamoff start = file.tellg();
+	file.seekg(0, std::ios::end);
+	const std::streamoff remaining = file.tellg() - start;
+	file.seekg(start);
+	if (!file || static_cast<unsigned long long>(remaining) < static_cast<unsigned long long>(header[1]) * c_valuesPerFrame * sizeof(FileValue))
+		return false;
+
+	m_poses.resize(header[1]);
+	for (CameraPose& pose : m_poses)
+	{
+		FileValue values[c_valuesPerFrame];
+		if (!file.read(reinterpret_cast<char*>(values), sizeof(values)))
+		{
+			m_poses.clear();
+			return false;
+		}
+
+		pose.time = values[0].f;
+		pose.position = Point3D(values[1].f, values[2].f, values[3].f);
+		pose.rotation = Vector3D(values[4].f, values[5].f, values[6].f);
+		pose.viewPlaneDistance = values[7].f;
+
+		const unsigned flags = values[8].u;
+		const unsigned shadowMode = (flags >> c_shadowModeShift) & c_shadowModeMask;
+		if (shadowMode > static_cast<unsigned>(Camera::ShadowMode::Map))
+		{
+			m_poses.clear();
+			return false;
+		}
+		pose.animate = (flags & c_animateFlag) != 0;
+		pose.visibilityMode = (flags & c_rasteriseFlag) != 0 ? Camera::VisibilityMode::Rasterise : Camera::VisibilityMode::RayCast;
+		pose.shadowMode = static_cast<Camera::ShadowMode>(shadowMode);
+		pose.maxReflectionDepth = (flags >> c_reflectionDepthShift) & c_reflectionDepthMask;
+		pose.wavefront = (flags & c_wavefrontFlag) != 0;
+		pose.pathTracing = (flags & c_pathTracingFlag) != 0;
+		pose.sortSecondaryRays = (flags & c_sortSecondaryRaysFlag) != 0;
+		pose.toneMap = (flags & c_reinhardFlag) != 0 ? ToneMapSettings::Operator::Reinhard : ToneMapSettings::Operator::Clamp;
+		pose.shadowMapResolution = 1u << ((flags >> c_shadowMapResolutionShift) & c_shadowMapResolutionMask);
+		pose.shadowMapDepthBias = values[9].f;
+	}
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "Camera.h"
+#include <vector>
+
+// The camera's pose on one frame, along with the render settings that change the frame's workload
+struct CameraPose
+{
+	float		time = 0.0f;				// Seconds since the start of the recording
+	Point3D		position;					// World space position of the camera
+	Vector3D	rotation;					// Euler rotation of the camera
+	float		viewPlaneDistance = 0.0f;	// Distance from the camera to the view plane
+	bool		animate = false;			// Whether the dynamic objects moved on this frame
+
+	Camera::VisibilityMode		visibilityMode = Camera::VisibilityMode::RayCast;
+	Camera::ShadowMode			shadowMode = Camera::ShadowMode::None;
+	unsigned					maxReflectionDepth = 0;		// Up to 15
+	bool						wavefront = false;
+	bool						pathTracing = false;
+	bool						sortSecondaryRays = false;
+	ToneMapSettings::Operator	toneMap = ToneMapSettings::Operator::Clamp;
+	unsigned					shadowMapResolution = 512;	// A power of two, up to 2^15
+	float						shadowMapDepthBias = 0.05f;
+};
+
+// A recording of the camera's pose and render settings on every frame, so the same sequence of
+// frames can be rendered again exactly, e.g. to compare the performance of two builds.
+//
+// The file is binary and little endian: the 4 byte identifier "CPTH", a 32 bit version number
+// and a 32 bit frame count, followed by one record per frame of 10 32 bit values: the time, the
+// position's x, y and z, the rotation's x, y and z, the view plane distance, the flags, and the
+// shadow map's depth bias. The flags are:
+//	bit 0		set if the objects were animated
+//	bit 1		set if visibility was rasterised rather than ray cast
+//	bits 2-3	the shadow mode (none, rays or map)
+//	bits 4-7	the maximum reflection depth
+//	bit 8		set if the wavefront renderer was used
+//	bit 9		set if the frame was path traced
+//	bit 10		set if the reflection rays were sorted
+//	bit 11		set if the Reinhard tone map was used rather than clamping
+//	bits 12-15	log2 of the shadow map's resolution
+class CameraPath
+{
+public:
+	void clear() { m_poses.clear(); }
+	void add(const CameraPose& pose) { m_poses.push_back(pose); }
+
+	unsigned			size() const { return static_cast<unsigned>(m_poses.size()); }
+	const CameraPose&	operator[](unsigned frame) const { return m_poses[frame]; }
+
+	// Write the recording to a file, or read it back. Return false if the file can't be used.
+	bool save(const char* filename) const;
+	bool load(const char* filename);
+
+private:
+	std::vector<CameraPose> m_poses;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+// Caps the frame rate without vsync, by waiting before each present until the frame's slot in a
+// fixed schedule. The wait sleeps while there is plenty of time left and spins for the last
+// couple of milliseconds, since sleeps are only accurate to about a millisecond (SDL asks
+// Windows for a 1 ms timer resolution), so frames are paced precisely without busy waiting
+// for the whole frame.
+class FrameLimiter
+{
+public:
+	// Sets the frame rate to cap at, or 0 for no cap
+	void setFrameRate(unsigned framesPerSecond)
+	{
+		m_frameRate = framesPerSecond;
+		m_period = framesPerSecond > 0 ? SDL_GetPerformanceFrequency() / framesPerSecond : 0;
+		m_nextFrame = 0;
+	}
+	unsigned getFrameRate() const { return m_frameRate; }
+
+	// Waits until it is time for the next frame
+	void wait()
+	{
+		if (m_period == 0)
+			return;
+
+		// Start the schedule again after a frame that missed its slot, rather than rushing to catch up
+		const Uint64 now = SDL_GetPerformanceCounter();
+		if (m_nextFrame == 0 || now > m_nextFrame + m_period)
+			m_nextFrame = now;
+		waitUntil(m_nextFrame);
+		m_nextFrame += m_period;
+	}
+
+	// Sleeps and then spins until the performance counter reaches the given value
+	static void waitUntil(Uint64 counter)
+	{
+		const Uint64 frequency = SDL_GetPerformanceFrequency();
+		for (Uint64 now = SDL_GetPerformanceCounter(); now < counter; now = SDL_GetPerformanceCounter())
+		{
+			if ((counter - now) * 1000 > frequency * c_spinTime)
+				SDL_Delay(1);
+		}
+	}
+
+	static const unsigned c_spinTime = 2;	// Time spent spinning at the end of each wait (ms)
+
+private:
+	unsigned	m_frameRate = 0;
+	Uint64		m_period = 0;			// Performance counter ticks per frame, or 0 for no cap
+	Uint64		m_nextFrame = 0;		// Performance counter value when the next frame is due, or 0 to start the schedule
+};
@@ -0,0 +1,93 @@
+#include "stdafx.h"
+#include "Frustum.h"
+#include <xmmintrin.h>
+
+// Sets up the frustum planes from the view plane properties. Params are:
+//	viewPlaneDistance		distance from the camera to the view plane (along the z-axis)
+//	halfWidth, halfHeight	half extents of the view plane along the x- and y-axes
+//	nearDistance			distance of the near plane; anything closer than this is treated as behind the camera
+void Frustum::set(float viewPlaneDistance, float halfWidth, float halfHeight, float nearDistance)
+{
+	m_nearDistance = nearDistance;
+
+	// Near plane: z >= nearDistance
+	m_normalX[c_near] = 0.0f;
+	m_normalY[c_near] = 0.0f;
+	m_normalZ[c_near] = 1.0f;
+	m_offset[c_near] = -nearDistance;
+
+	// Each side plane contains the origin and one edge of the view plane, e.g. the left plane
+	// contains (-halfWidth, y, viewPlaneDistance) for all y, so its normal is (d, 0, w) normalised.
+	const float invLenX = 1.0f / sqrtf(viewPlaneDistance * viewPlaneDistance + halfWidth * halfWidth);
+	const float invLenY = 1.0f / sqrtf(viewPlaneDistance * viewPlaneDistance + halfHeight * halfHeight);
+
+	m_normalX[c_left] = viewPlaneDistance * invLenX;
+	m_normalY[c_left] = 0.0f;
+	m_normalZ[c_left] = halfWidth * invLenX;
+
+	m_normalX[c_right] = -viewPlaneDistance * invLenX;
+	m_normalY[c_right] = 0.0f;
+	m_normalZ[c_right] = halfWidth * invLenX;
+
+	m_normalX[c_bottom] = 0.0f;
+	m_normalY[c_bottom] = viewPlaneDistance * invLenY;
+	m_normalZ[c_bottom] = halfHeight * invLenY;
+
+	m_normalX[c_top] = 0.0f;
+	m_normalY[c_top] = -viewPlaneDistance * invLenY;
+	m_normalZ[c_top] = halfHeight * invLenY;
+
+	m_offset[c_left] = m_offset[c_right] = m_offset[c_bottom] = m_offset[c_top] = 0.0f;
+}
+
+// Tests four spheres at a time against every plane; a sphere is culled as soon as its centre
+// is further than its radius behind any one of the planes.
+void Frustum::cullSpheres(const BoundingSpheres& bounds, std::vector<unsigned char>& visible, CullingStats& stats) const
+{
+	const unsigned padded = static_cast<unsigned>(bounds.radius.size());
+	visible.resize(padded);
+
+	stats.tested = bounds.count;
+	stats.behindCamera = 0;
+	stats.outsideView = 0;
+
+	const __m128 nearNormalZ = _mm_set1_ps(m_normalZ[c_near]), nearOffset = _mm_set1_ps(m_offset[c_near]);
+
+	for (unsigned i = 0; i < padded; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&bounds.x[i]),
+			y = _mm_loadu_ps(&bounds.y[i]),
+			z = _mm_loadu_ps(&bounds.z[i]),
+			negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i]));
+
+		// Behind the camera: distance to the near plane is less than -radius
+		const __m128 nearDist = _mm_add_ps(_mm_mul_ps(z, nearNormalZ), nearOffset);
+		const __m128 behind = _mm_cmplt_ps(nearDist, negRadius);
+
+		// Outside any of the four side planes
+		__m128 outside = _mm_setzero_ps();
+		for (unsigned p = c_left; p < c_numPlanes; ++p)
+		{
+			const __m128 dist = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(x, _mm_set1_ps(m_normalX[p])),
+				_mm_mul_ps(y, _mm_set1_ps(m_normalY[p]))),
+				_mm_mul_ps(z, _mm_set1_ps(m_normalZ[p])));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negRadius));
+		}
+
+		const int behindMask = _mm_movemask_ps(behind);
+		const int outsideMask = _mm_movemask_ps(_mm_andnot_ps(behind, outside));
+		for (unsigned k = 0; k < 4; ++k)
+		{
+			const bool isBehind = (behindMask >> k) & 1, isOutside = (outsideMask >> k) & 1;
+			visible[i + k] = !(isBehind || isOutside);
+
+			// Padding entries are not counted
+			if (i + k < bounds.count)
+			{
+				stats.behindCamera += isBehind;
+				stats.outsideView += isOutside;
+			}
+		}
+	}
+}
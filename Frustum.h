@@ -0,0 +1,65 @@
+#pragma once
+#include "Point3D.h"
+#include <vector>
+
+// Structure holding the number of objects removed by the culling stage on each frame
+struct CullingStats
+{
+	unsigned tested = 0;		// Number of object bounds tested against the frustum
+	unsigned behindCamera = 0;	// Objects lying entirely behind the camera's near plane
+	unsigned outsideView = 0;	// Objects in front of the camera, but outside the edges of the view plane
+
+	unsigned culled() const { return behindCamera + outsideView; }
+};
+
+// Bounding spheres for a set of objects, stored as separate arrays (structure of arrays)
+// so that they can be tested four at a time. The arrays are padded to a multiple of four.
+struct BoundingSpheres
+{
+	std::vector<float> x, y, z, radius;
+	unsigned count = 0;
+
+	// Resizes the arrays to hold n spheres; padding entries have a negative radius so they are always culled
+	void resize(unsigned n)
+	{
+		count = n;
+		const unsigned padded = (n + 3) & ~3u;
+		x.resize(padded, 0.0f);
+		y.resize(padded, 0.0f);
+		z.resize(padded, 0.0f);
+		radius.assign(padded, -1.0f);
+	}
+
+	void set(unsigned index, const Point3D& centre, float r)
+	{
+		x[index] = centre.x;
+		y[index] = centre.y;
+		z[index] = centre.z;
+		radius[index] = r;
+	}
+};
+
+// The camera's view volume in camera space. The apex is at the origin, the camera looks along
+// the positive z-axis, and the four side planes pass through the edges of the view plane.
+class Frustum
+{
+public:
+	// Sets up the frustum planes from the view plane properties
+	void set(float viewPlaneDistance, float halfWidth, float halfHeight, float nearDistance = 1e-3f);
+
+	// Tests all of the given spheres against the frustum, four at a time.
+	// Params:
+	//	bounds		the spheres to test (input)
+	//	visible		one flag per sphere, set to 1 if the sphere may be visible or 0 if it is culled (output)
+	//	stats		the number of culled spheres (output)
+	void cullSpheres(const BoundingSpheres& bounds, std::vector<unsigned char>& visible, CullingStats& stats) const;
+
+	float nearDistance() const { return m_nearDistance; }
+
+private:
+	enum { c_near, c_left, c_right, c_bottom, c_top, c_numPlanes };
+
+	// Unit normals (pointing into the frustum) and offsets of each plane: n.p + d >= 0 inside
+	float m_normalX[c_numPlanes], m_normalY[c_numPlanes], m_normalZ[c_numPlanes], m_offset[c_numPlanes];
+	float m_nearDistance = 1e-3f;
+};
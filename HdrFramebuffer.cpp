@@ -0,0 +1,83 @@
+#include "stdafx.h"
+#include "HdrFramebuffer.h"
+#include <emmintrin.h>
+
+namespace
+{
+	// Table converting a value from 0 to 1 (scaled to the table size) to 8 bits, either
+	// directly or through the sRGB transfer curve
+	struct EncodeTable
+	{
+		unsigned char values[HdrFramebuffer::c_encodeTableSize];
+
+		explicit EncodeTable(bool srgb)
+		{
+			for (unsigned k = 0; k < HdrFramebuffer::c_encodeTableSize; ++k)
+			{
+				const float linear = static_cast<float>(k) / (HdrFramebuffer::c_encodeTableSize - 1);
+				float encoded = linear;
+				if (srgb)
+					encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+				values[k] = static_cast<unsigned char>(encoded * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const EncodeTable& getEncodeTable(bool srgb)
+	{
+		static const EncodeTable linearTable(false), srgbTable(true);
+		return srgb ? srgbTable : linearTable;
+	}
+}
+
+void HdrFramebuffer::resize(unsigned width, unsigned height)
+{
+	m_width = width;
+	m_height = height;
+	const unsigned padded = (width * height + 3) & ~3u;
+	m_r.resize(padded);
+	m_g.resize(padded);
+	m_b.resize(padded);
+}
+
+void HdrFramebuffer::clear(unsigned begin, unsigned end)
+{
+	for (unsigned k = begin; k < end; ++k)
+		m_r[k] = m_g[k] = m_b[k] = 0.0f;
+}
+
+// Each group of four pixels is scaled by the exposure, tone mapped and turned into table
+// indices with SIMD, then looked up and packed into four RGBA8888 colours (alpha 255).
+// Params:
+//	settings		exposure, tone mapping operator and encoding
+//	image			width * height colours (output)
+//	begin, end		range of pixels to resolve
+void HdrFramebuffer::resolve(const ToneMapSettings& settings, std::vector<Colour>& image, unsigned begin, unsigned end) const
+{
+	const unsigned char* table = getEncodeTable(settings.srgb).values;
+	const bool reinhard = settings.op == ToneMapSettings::Operator::Reinhard;
+	const __m128 exposure = _mm_set1_ps(settings.exposure), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 tableScale = _mm_set1_ps(static_cast<float>(c_encodeTableSize - 1));
+
+	unsigned* out = reinterpret_cast<unsigned*>(image.data());
+	const unsigned size = m_width * m_height;
+	end = min(end, size);
+	for (unsigned k = begin; k < end; k += 4)
+	{
+		__m128 channels[3] = { _mm_load_ps(&m_r[k]), _mm_load_ps(&m_g[k]), _mm_load_ps(&m_b[k]) };
+		alignas(16) int indices[3][4];
+		for (unsigned c = 0; c < 3; ++c)
+		{
+			__m128 value = _mm_max_ps(_mm_mul_ps(channels[c], exposure), zero);
+			if (reinhard)
+				value = _mm_div_ps(value, _mm_add_ps(value, one));
+			value = _mm_min_ps(value, one);
+			_mm_store_si128(reinterpret_cast<__m128i*>(indices[c]), _mm_cvtps_epi32(_mm_mul_ps(value, tableScale)));
+		}
+
+		// The colour is laid out as r, g, b, a bytes, which is this order in a little endian 32 bit value
+		const unsigned count = min(4u, end - k);
+		for (unsigned p = 0; p < count; ++p)
+			out[k + p] = table[indices[0][p]] | (table[indices[1][p]] << 8) | (table[indices[2][p]] << 16) | 0xFF000000u;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "Object.h"
+#include "AlignedAllocator.h"
+#include <vector>
+
+// How the high dynamic range colours are brought into the displayable range
+struct ToneMapSettings
+{
+	enum class Operator
+	{
+		Clamp,		// Values above 1 are cut off at white
+		Reinhard,	// x / (1 + x), which rolls bright values off smoothly towards white
+	};
+
+	Operator	op = Operator::Clamp;
+	float		exposure = 1.0f;	// Scale applied to the colours before tone mapping
+	bool		srgb = false;		// Encode with the sRGB transfer curve, for colours that are linear light
+};
+
+// The frame being rendered, stored as floating point colours so that shading and accumulation
+// never clamp or round, with 1 as full white. The red, green and blue values are kept in separate
+// aligned arrays in image order (top row first), padded to a multiple of four pixels.
+// Once the frame is finished, resolve() tone maps, encodes and packs it into 8 bit colours
+// four pixels at a time.
+class HdrFramebuffer
+{
+public:
+	// Sets the size of the frame; the contents are undefined until written
+	void resize(unsigned width, unsigned height);
+
+	unsigned width() const { return m_width; }
+	unsigned height() const { return m_height; }
+	unsigned size() const { return m_width * m_height; }
+
+	// Sets every pixel in the range [begin, end) to black
+	void clear(unsigned begin, unsigned end);
+
+	// Get/set/add to a pixel's colour, by its index in image order
+	Vector3D	get(unsigned index) const { return Vector3D(m_r[index], m_g[index], m_b[index]); }
+	void		set(unsigned index, const Vector3D& colour) { m_r[index] = colour.x; m_g[index] = colour.y; m_b[index] = colour.z; }
+	void		add(unsigned index, const Vector3D& colour) { m_r[index] += colour.x; m_g[index] += colour.y; m_b[index] += colour.z; }
+
+	// Tone maps the pixels in the range [begin, end) and writes them to the image as RGBA8888 colours.
+	// begin must be a multiple of four; different ranges can be resolved on different threads.
+	void resolve(const ToneMapSettings& settings, std::vector<Colour>& image, unsigned begin, unsigned end) const;
+
+	// Number of entries in the tables that encode tone mapped values from 0 to 1 as 8 bits
+	static const unsigned c_encodeTableSize = 4096;
+
+private:
+	unsigned m_width = 0, m_height = 0;
+	AlignedFloatArray m_r, m_g, m_b;
+};
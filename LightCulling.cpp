@@ -0,0 +1,60 @@
+#include "stdafx.h"
+#include "LightCulling.h"
+
+// Builds the light list for every tile. Params are:
+//	pixels			the pixel buffer, after the visibility pass
+//	rayDirections	the camera space direction of the ray through each pixel
+//	context			the lights, in camera space
+void TileLightLists::build(const PixelBuffer& pixels, const RayDirectionTable& rayDirections, const ShadingContext& context)
+{
+	m_tilesX = pixels.tilesX();
+	m_offsets.resize(pixels.tilesX() * pixels.tilesY() + 1);
+	m_lights.clear();
+	m_stats = LightCullingStats();
+	m_stats.lights = context.numLights;
+
+	for (unsigned tileY = 0; tileY < pixels.tilesY(); ++tileY)
+	{
+		for (unsigned tileX = 0; tileX < pixels.tilesX(); ++tileX)
+		{
+			m_offsets[tileX + m_tilesX * tileY] = static_cast<unsigned>(m_lights.size());
+
+			// Find the box around the points seen by the tile's pixels
+			float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
+			for (PixelBuffer::Iterator it = pixels.beginTile(tileX, tileY), end = pixels.endTile(tileX, tileY); it != end; ++it)
+			{
+				const PixelBuffer::Pixel pixel = *it;
+				if (pixels.getObjectIndexAt(pixel.index) == PixelBuffer::c_noObject)
+					continue;
+
+				const Vector3D point = rayDirections.getDirection(pixel.i, pixel.j) * pixels.getDepthAt(pixel.index);
+				minX = min(minX, point.x);
+				minY = min(minY, point.y);
+				minZ = min(minZ, point.z);
+				maxX = max(maxX, point.x);
+				maxY = max(maxY, point.y);
+				maxZ = max(maxZ, point.z);
+			}
+			if (minX > maxX)
+				continue;
+
+			// Keep the lights whose range reaches the box
+			++m_stats.tiles;
+			for (unsigned l = 0; l < context.numLights; ++l)
+			{
+				if (context.isPoint[l])
+				{
+					const float dx = max(0.0f, max(minX - context.x[l], context.x[l] - maxX)),
+						dy = max(0.0f, max(minY - context.y[l], context.y[l] - maxY)),
+						dz = max(0.0f, max(minZ - context.z[l], context.z[l] - maxZ));
+					if (dx * dx + dy * dy + dz * dz >= context.rangeSquared[l])
+						continue;
+				}
+				m_lights.push_back(l);
+			}
+		}
+	}
+
+	m_offsets.back() = static_cast<unsigned>(m_lights.size());
+	m_stats.tileLights = static_cast<unsigned>(m_lights.size());
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "PixelBuffer.h"
+#include "RayDirectionTable.h"
+#include "Shading.h"
+#include <vector>
+
+// Structure holding the results of the light culling on each frame
+struct LightCullingStats
+{
+	unsigned lights = 0;		// Number of lights in the scene
+	unsigned tiles = 0;			// Number of tiles that see any objects
+	unsigned tileLights = 0;	// Total length of the tiles' light lists
+
+	float averageLightsPerTile() const { return tiles > 0 ? static_cast<float>(tileLights) / tiles : 0.0f; }
+};
+
+// A compact list of the lights that can reach each of the pixel buffer's tiles, so that
+// each pixel is only shaded with the lights near it. A tile's bounds are the box around the
+// points its pixels see, so a point light is kept if its range reaches that box.
+// Directional lights reach everything, so every tile that sees an object keeps them.
+class TileLightLists
+{
+public:
+	void build(const PixelBuffer& pixels, const RayDirectionTable& rayDirections, const ShadingContext& context);
+
+	// Get the lights for the tile with the given indices
+	const unsigned* getLights(unsigned tileX, unsigned tileY) const { return m_lights.data() + m_offsets[tileX + m_tilesX * tileY]; }
+	unsigned getNumLights(unsigned tileX, unsigned tileY) const
+	{
+		const unsigned tile = tileX + m_tilesX * tileY;
+		return m_offsets[tile + 1] - m_offsets[tile];
+	}
+
+	const LightCullingStats& getStats() const { return m_stats; }
+
+private:
+	unsigned				m_tilesX = 0;
+	std::vector<unsigned>	m_offsets;	// Start of each tile's list in m_lights, plus the end of the last one
+	std::vector<unsigned>	m_lights;	// The light indices of every tile, one list after another
+	LightCullingStats		m_stats;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include "Object.h"
+#include <vector>
+
+// A light shining on the scene. Directional lights are infinitely far away and light everything
+// from the same direction; point lights shine out from a position, fading to nothing at their range.
+struct LightSource
+{
+	enum class Type { Directional, Point };
+
+	Type		type = Type::Directional;
+	Point3D		position;							// World space position (point lights)
+	Vector3D	direction = Vector3D(0, -1, 0);		// World space direction the light travels in (directional lights)
+	Colour		colour = Colour(255, 255, 255);
+	float		intensity = 0.8f;
+	float		range = 0.0f;						// Distance beyond which a point light has no effect
+
+	// Helpers for setting up each type of light
+	static LightSource directional(const Vector3D& direction, const Colour& colour, float intensity)
+	{
+		LightSource light;
+		light.direction = direction;
+		light.colour = colour;
+		light.intensity = intensity;
+		return light;
+	}
+
+	static LightSource point(const Point3D& position, float range, const Colour& colour, float intensity)
+	{
+		LightSource light;
+		light.type = Type::Point;
+		light.position = position;
+		light.range = range;
+		light.colour = colour;
+		light.intensity = intensity;
+		return light;
+	}
+};
+
+// The lights in a scene. As with MaterialTable, each property is kept in its own array,
+// so that the per-frame preparation can work through them in order.
+class LightList
+{
+public:
+	// Adds a light to the list, returning its index
+	unsigned add(const LightSource& light)
+	{
+		const unsigned index = size();
+		m_types.push_back(light.type);
+		m_positions.push_back(light.position);
+		m_directions.push_back(light.direction);
+		m_colours.push_back(light.colour);
+		m_intensities.push_back(light.intensity);
+		m_ranges.push_back(light.range);
+		return index;
+	}
+
+	// Replaces the light with the given index
+	void set(unsigned index, const LightSource& light)
+	{
+		m_types[index] = light.type;
+		m_positions[index] = light.position;
+		m_directions[index] = light.direction;
+		m_colours[index] = light.colour;
+		m_intensities[index] = light.intensity;
+		m_ranges[index] = light.range;
+	}
+
+	void clear()
+	{
+		m_types.clear();
+		m_positions.clear();
+		m_directions.clear();
+		m_colours.clear();
+		m_intensities.clear();
+		m_ranges.clear();
+	}
+
+	unsigned size() const { return static_cast<unsigned>(m_types.size()); }
+
+	// Access to individual properties
+	LightSource::Type	type(unsigned index) const { return m_types[index]; }
+	const Point3D&		position(unsigned index) const { return m_positions[index]; }
+	const Vector3D&		direction(unsigned index) const { return m_directions[index]; }
+	const Colour&		colour(unsigned index) const { return m_colours[index]; }
+	float				intensity(unsigned index) const { return m_intensities[index]; }
+	float				range(unsigned index) const { return m_ranges[index]; }
+
+private:
+	std::vector<LightSource::Type>	m_types;
+	std::vector<Point3D>			m_positions;
+	std::vector<Vector3D>			m_directions;
+	std::vector<Colour>				m_colours;
+	std::vector<float>				m_intensities, m_ranges;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include "Object.h"
+#include "SpecularPower.h"
+#include <vector>
+
+// The shading parameters of a surface
+struct Material
+{
+	Colour	colour = Colour(126, 126, 126);	// The surface's RGBA colour
+	float	diffuse = 1.0f;					// kd: diffuse reflection constant
+	float	specular = 10.0f;				// ks: specular reflection constant
+	float	ambient = 0.18f;				// ka: ambient reflection constant
+	float	shininess = 10.0f;				// Exponent controlling the size of the specular highlights (higher is smaller and sharper)
+	float	reflectivity = 0.0f;			// Fraction of the surface's colour that comes from mirror reflection (0 to 1)
+
+	Material() {}
+	Material(const Colour& c) : colour(c) {}
+};
+
+// The materials used in a scene. Objects refer to a material by its index, so many objects
+// can share one. Each parameter is kept in its own array (structure of arrays), so shading only
+// reads the parameters it uses, and each material's specular power is prepared when it is set.
+// Index 0 always holds a default material.
+class MaterialTable
+{
+public:
+	MaterialTable() { add(Material()); }
+
+	// Adds a material to the table, returning its index
+	unsigned add(const Material& material)
+	{
+		const unsigned index = size();
+		m_colours.push_back(material.colour);
+		m_diffuse.push_back(material.diffuse);
+		m_specular.push_back(material.specular);
+		m_ambient.push_back(material.ambient);
+		m_shininess.push_back(material.shininess);
+		m_reflectivity.push_back(material.reflectivity);
+		m_specularPowers.push_back(SpecularPower());
+		m_specularPowers.back().setExponent(material.shininess);
+		return index;
+	}
+
+	// Replaces the material with the given index
+	void set(unsigned index, const Material& material)
+	{
+		m_colours[index] = material.colour;
+		m_diffuse[index] = material.diffuse;
+		m_specular[index] = material.specular;
+		m_ambient[index] = material.ambient;
+		m_shininess[index] = material.shininess;
+		m_reflectivity[index] = material.reflectivity;
+		m_specularPowers[index].setExponent(material.shininess);
+	}
+
+	// Gets a copy of the material with the given index
+	Material get(unsigned index) const
+	{
+		Material material(m_colours[index]);
+		material.diffuse = m_diffuse[index];
+		material.specular = m_specular[index];
+		material.ambient = m_ambient[index];
+		material.shininess = m_shininess[index];
+		material.reflectivity = m_reflectivity[index];
+		return material;
+	}
+
+	unsigned size() const { return static_cast<unsigned>(m_colours.size()); }
+
+	// Access to individual parameters, for shading
+	const Colour&			colour(unsigned index) const { return m_colours[index]; }
+	float					diffuse(unsigned index) const { return m_diffuse[index]; }
+	float					specular(unsigned index) const { return m_specular[index]; }
+	float					ambient(unsigned index) const { return m_ambient[index]; }
+	float					shininess(unsigned index) const { return m_shininess[index]; }
+	float					reflectivity(unsigned index) const { return m_reflectivity[index]; }
+	const SpecularPower&	specularPower(unsigned index) const { return m_specularPowers[index]; }
+
+private:
+	std::vector<Colour>			m_colours;
+	std::vector<float>			m_diffuse, m_specular, m_ambient, m_shininess, m_reflectivity;
+	std::vector<SpecularPower>	m_specularPowers;
+};
@@ -6,7 +6,7 @@
 //	n				The unit vector that is normal to the plane (in world space)
 //	up				The unit vector along which the plane height is measured (in world space; should be orthogonal to the normal)
 //	w, h			The width and height of the plane (zero/negative for an infinite plane)
-Plane::Plane(Point3D centrePoint, Vector3D n, Vector3D up, float w, float h) :
+Plane::Plane(const Point3D& centrePoint, const Vector3D& n, const Vector3D& up, float w, float h) :
 	Object(centrePoint),
 	m_heightDirection(up),
 	m_normal(n),
@@ -80,7 +80,7 @@ bool Plane::getIntersection(const Point3D& raySrc, const Vector3D& rayDir, float
 //--------------------------------------------------------------------------------------------------------------------//
 
 // Transforms the object using the given matrix.
-void Plane::applyTransformation(const Matrix3D & matrix)
+void Plane::applyTransformation(const AffineMatrix3D& matrix)
 {
 	m_centre = matrix * m_centre;
 	m_heightDirection = matrix * m_heightDirection;
@@ -88,6 +88,28 @@ void Plane::applyTransformation(const Matrix3D & matrix)
 	m_normal = matrix * m_normal;
 }
 
+// Gets one of the plane's normal, width or height directions
+Vector3D Plane::getDirection(unsigned index) const
+{
+	switch (index)
+	{
+	case c_normal:	return m_normal;
+	case c_width:	return m_widthDirection;
+	default:		return m_heightDirection;
+	}
+}
+
+// Sets one of the plane's normal, width or height directions
+void Plane::setDirection(unsigned index, const Vector3D& direction)
+{
+	switch (index)
+	{
+	case c_normal:	m_normal = direction; break;
+	case c_width:	m_widthDirection = direction; break;
+	default:		m_heightDirection = direction; break;
+	}
+}
+
 float Sphere::getDistToIntersection(const Point3D& raySrc, const Vector3D& rayDir) const 
 {
 	 
@@ -129,7 +151,7 @@ Vector3D Sphere::calculateNormal(Point3D& pointOnSurface) const {
 }
 
 // Transforms the object using the given matrix.
-void Sphere::applyTransformation(const Matrix3D & matrix)
+void Sphere::applyTransformation(const AffineMatrix3D& matrix)
 {
 	m_centre = matrix * m_centre;
 }
@@ -139,7 +161,7 @@ bool Light::getIntersection(const Point3D& raySrc, const Vector3D& rayDir, float
 	return false;
 }
 
-void Light::applyTransformation(const Matrix3D& matrix)
+void Light::applyTransformation(const AffineMatrix3D& matrix)
 {
 	m_centre = matrix * m_centre;
 
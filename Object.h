@@ -1,5 +1,5 @@
 #pragma once
-#include "Matrix3D.h"
+#include "AffineMatrix3D.h"
 #include "PixelBuffer.h"
 // Structure holding RGBA colour components
 struct Colour
@@ -12,7 +12,7 @@ struct Colour
 class Object
 {
 public:
-	Object(Point3D centrePoint = Point3D()) : m_centre(centrePoint){}
+	Object(const Point3D& centrePoint = Point3D()) : m_centre(centrePoint){}
 	virtual ~Object() {}
 
 	// Returns true if the ray intersects with this object.
@@ -23,22 +23,29 @@ public:
 	virtual bool getIntersection(const Point3D& raySrc, const Vector3D& rayDir, float& distToFirstIntersection) const = 0;
 	Point3D intersectionPoint;
 
+	// Returns the unit length surface normal at the given point on the object.
+	virtual Vector3D getNormalAt(const Point3D& pointOnSurface) const = 0;
+
 	// Transforms the object using the given matrix.
-	virtual void applyTransformation(const Matrix3D& matrix) = 0;
+	virtual void applyTransformation(const AffineMatrix3D& matrix) = 0;
 
 	// Access the object's position
 	const Point3D& position() const { return m_centre; }
+	void setPosition(const Point3D& centre) { m_centre = centre; }
+
+	// Access the directions that orient the object (e.g. a plane's normal), so that objects
+	// can be transformed in batches by transforming their position and directions.
+	virtual unsigned getNumDirections() const { return 0; }
+	virtual Vector3D getDirection(unsigned) const { return Vector3D(); }
+	virtual void setDirection(unsigned, const Vector3D&) {}
 
 	// Get the maximum distance of any of the object's vertices from its centre
 	virtual float getMaxRadius() const = 0;
 	
 
 
-	// The object's RGBA colour
-	Colour	m_colour = Colour(126, 126, 126);
-
-	// The objects Albedo value (how much light is reflected/absorbed)
-	Vector3D albedo;
+	// Index of the object's material in the scene's MaterialTable
+	unsigned	m_material = 0;
 	
 	Vector3D hitNormal;
 
@@ -55,19 +62,31 @@ protected:
 class Plane : public Object
 {
 public:
-	Plane(Point3D centrePoint = Point3D(),
-		Vector3D n = Vector3D(0.0f, 1.0f, 0.0f),
-		Vector3D up = Vector3D(0.0f, 0.0f, 1.0f),
+	Plane(const Point3D& centrePoint = Point3D(),
+		const Vector3D& n = Vector3D(0.0f, 1.0f, 0.0f),
+		const Vector3D& up = Vector3D(0.0f, 0.0f, 1.0f),
 		float w = 0.0f, float h = 0.0f);
 	virtual ~Plane() {}
 
 	virtual Vector3D calculateNormal() const { return m_normal; } //This is because the normal for a plane is given as just N.
 	virtual float getDistToIntersection(const Point3D& raySrc, const Vector3D& rayDir) const;
 	virtual bool getIntersection(const Point3D& raySrc, const Vector3D& rayDir, float& distToFirstIntersection) const;
-	virtual void applyTransformation(const Matrix3D& matrix);
+	virtual Vector3D getNormalAt(const Point3D&) const { return m_normal; }
+	virtual void applyTransformation(const AffineMatrix3D& matrix);
 	virtual float getMaxRadius() const { return m_halfDiagonal; }
+	virtual unsigned getNumDirections() const { return c_numDirections; }
+	virtual Vector3D getDirection(unsigned index) const;
+	virtual void setDirection(unsigned index, const Vector3D& direction);
+
+	const Vector3D& getWidthDirection() const { return m_widthDirection; }
+	const Vector3D& getHeightDirection() const { return m_heightDirection; }
+	float getHalfWidth() const { return m_halfWidth; }
+	float getHalfHeight() const { return m_halfHeight; }
 
 private:
+	// The directions returned by getDirection()
+	enum { c_normal, c_width, c_height, c_numDirections };
+
 	// The plane's orientation is defined by its normal and the directions of its width and height in world space.
 	Vector3D	m_normal = Vector3D(0.0f, 1.0f, 0.0f),
 				m_widthDirection = Vector3D(1.0f, 0.0f, 0.0f),
@@ -82,15 +101,17 @@ private:
 class Sphere : public Object
 {
 public:
-	Sphere(Point3D centrePoint = Point3D(), float r = 1.0f) : Object(centrePoint), m_radius(r), m_radius2(r * r) {}
+	Sphere(const Point3D& centrePoint = Point3D(), float r = 1.0f) : Object(centrePoint), m_radius(r), m_radius2(r * r) {}
 	virtual ~Sphere() {}
 
 	//Get the normal of a given object
 	virtual Vector3D calculateNormal(Point3D& pointOnSurface) const;
 	virtual float getDistToIntersection(const Point3D& raySrc, const Vector3D& rayDir) const;
 	virtual bool getIntersection(const Point3D& raySrc, const Vector3D& rayDir, float& distToFirstIntersection) const;
-	virtual void applyTransformation(const Matrix3D& matrix);
+	virtual Vector3D getNormalAt(const Point3D& pointOnSurface) const { return (pointOnSurface - m_centre) * (1.0f / m_radius); }
+	virtual void applyTransformation(const AffineMatrix3D& matrix);
 	virtual float getMaxRadius() const { return m_radius; }
+	float getRadius() const { return m_radius; }
 
 
 private:
@@ -102,12 +123,13 @@ private:
 class Light : public Object
 {
 public:
-	Light(Point3D centrePoint = Point3D(), float ambientIntensity=0.18f) : Object(centrePoint), ambientIntensity(ambientIntensity) {}
+	Light(const Point3D& centrePoint = Point3D(), float ambientIntensity=0.18f) : Object(centrePoint), ambientIntensity(ambientIntensity) {}
 	virtual ~Light() {}
 	float ambientIntensity;
 
 	virtual bool getIntersection(const Point3D& raySrc, const Vector3D& rayDir, float& distToFirstIntersection) const;
-	virtual void applyTransformation(const Matrix3D& matrix);
+	virtual Vector3D getNormalAt(const Point3D&) const { return Vector3D(); }
+	virtual void applyTransformation(const AffineMatrix3D& matrix);
 	virtual float getMaxRadius() const { return 0; }
 
 };
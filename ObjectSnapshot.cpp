@@ -0,0 +1,44 @@
+#include "stdafx.h"
+#include "ObjectSnapshot.h"
+
+const float ObjectSnapshot::c_tolerance = 1e-4f;
+
+void ObjectSnapshot::store(const std::vector<Object*>& objects)
+{
+	unsigned numDirections = 0;
+	for (auto obj : objects)
+		numDirections += obj->getNumDirections();
+
+	m_positions.resize(static_cast<unsigned>(objects.size()));
+	m_directions.resize(numDirections);
+	for (unsigned k = 0, d = 0; k < objects.size(); ++k)
+	{
+		m_positions.setPoint(k, objects[k]->position());
+		for (unsigned n = 0; n < objects[k]->getNumDirections(); ++n, ++d)
+			m_directions.setVector(d, objects[k]->getDirection(n));
+	}
+}
+
+bool ObjectSnapshot::hasChanged(const std::vector<Object*>& objects) const
+{
+	if (objects.size() != m_positions.count)
+		return true;
+
+	unsigned d = 0;
+	for (unsigned k = 0; k < objects.size(); ++k)
+	{
+		const Vector3D moved = objects[k]->position() - m_positions.getPoint(k);
+		if (moved.dot(moved) > c_tolerance * c_tolerance)
+			return true;
+
+		for (unsigned n = 0; n < objects[k]->getNumDirections(); ++n, ++d)
+		{
+			if (d >= m_directions.count)
+				return true;
+			const Vector3D turned = objects[k]->getDirection(n) - m_directions.getVector(d);
+			if (turned.dot(turned) > c_tolerance * c_tolerance)
+				return true;
+		}
+	}
+	return d != m_directions.count;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "Object.h"
+#include "Vector3DArray.h"
+#include <vector>
+
+// A copy of the positions and orientations of a set of objects, for finding out later whether
+// any of them have moved. Moving objects between world and camera space every frame leaves tiny
+// rounding differences, so changes smaller than c_tolerance are ignored.
+class ObjectSnapshot
+{
+public:
+	static const float c_tolerance;
+
+	// Keeps a copy of the objects' positions and directions
+	void store(const std::vector<Object*>& objects);
+
+	// Returns true if any object has moved or turned since store() was called, or if there are a different number of them
+	bool hasChanged(const std::vector<Object*>& objects) const;
+
+private:
+	Vector3DArray	m_positions;	// Each object's position
+	Vector3DArray	m_directions;	// Each object's orientation directions, one after the other
+};
@@ -0,0 +1,34 @@
+#include "stdafx.h"
+#include "ObjectTransformBatch.h"
+
+// Transforms all of the given objects by the matrix. Params are:
+//	matrix		the transformation to apply
+//	objects		the objects to transform, which are updated in place
+void ObjectTransformBatch::apply(const AffineMatrix3D& matrix, const std::vector<Object*>& objects)
+{
+	const unsigned numObjects = static_cast<unsigned>(objects.size());
+	unsigned numDirections = 0;
+	for (auto obj : objects)
+		numDirections += obj->getNumDirections();
+
+	// Gather
+	m_positions.resize(numObjects);
+	m_directions.resize(numDirections);
+	for (unsigned k = 0, d = 0; k < numObjects; ++k)
+	{
+		m_positions.setPoint(k, objects[k]->position());
+		for (unsigned n = 0; n < objects[k]->getNumDirections(); ++n, ++d)
+			m_directions.setVector(d, objects[k]->getDirection(n));
+	}
+
+	matrix.transformPoints(m_positions, m_positions);
+	matrix.transformVectors(m_directions, m_directions);
+
+	// Scatter
+	for (unsigned k = 0, d = 0; k < numObjects; ++k)
+	{
+		objects[k]->setPosition(m_positions.getPoint(k));
+		for (unsigned n = 0; n < objects[k]->getNumDirections(); ++n, ++d)
+			objects[k]->setDirection(n, m_directions.getVector(d));
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "AffineMatrix3D.h"
+#include "Object.h"
+#include <vector>
+
+// Applies a transformation to many objects at once. The objects' positions and directions are
+// gathered into arrays, transformed four at a time, and then written back to the objects.
+// The arrays are kept between calls, so transforming the same scene again doesn't allocate.
+class ObjectTransformBatch
+{
+public:
+	// Transforms all of the given objects by the matrix
+	void apply(const AffineMatrix3D& matrix, const std::vector<Object*>& objects);
+
+private:
+	Vector3DArray	m_positions;	// One position per object
+	Vector3DArray	m_directions;	// The directions of all of the objects, one after the other
+};
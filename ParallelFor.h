@@ -0,0 +1,18 @@
+#pragma once
+#include "ThreadPool.h"
+
+// Runs body(begin, end) over the range [0, count), split into chunks of at least minChunk items
+// that are shared out between the threads of the running ThreadPool. The calling thread works on
+// chunks itself, and the call returns once every chunk is finished. Without a running pool (or
+// when called from inside another parallel loop) the whole range is run on the calling thread.
+// The body must be safe to run on several threads at once, each with a different range.
+template <typename Body>
+void parallelFor(unsigned count, unsigned minChunk, const Body& body)
+{
+	ThreadPool* pool = ThreadPool::current();
+	if (pool != nullptr && pool->run(count, minChunk, body))
+		return;
+
+	if (count > 0)
+		body(0u, count);
+}
@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "PathTracer.h"
+#include "ParallelFor.h"
+
+namespace
+{
+	const float c_pi = 3.14159265f;
+
+	// Makes two unit vectors at right angles to the (unit) normal and each other
+	void makeBasis(const Vector3D& normal, Vector3D& tangent, Vector3D& bitangent)
+	{
+		const float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+		const float a = -1.0f / (sign + normal.z), b = normal.x * normal.y * a;
+		tangent = Vector3D(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+		bitangent = Vector3D(b, sign + normal.y * normal.y * a, -normal.y);
+	}
+
+	// Picks a direction around the normal, with a probability proportional to its cosine with the normal
+	Vector3D sampleCosineHemisphere(const Vector3D& normal, Random& random)
+	{
+		const float u = random.nextFloat(), v = random.nextFloat();
+		const float radius = sqrtf(u), angle = 2.0f * c_pi * v;
+		Vector3D tangent, bitangent;
+		makeBasis(normal, tangent, bitangent);
+		return tangent * (radius * cosf(angle)) + bitangent * (radius * sinf(angle)) + normal * sqrtf(max(0.0f, 1.0f - u));
+	}
+}
+
+// Traces one path through each pixel and updates the image with the running average. Params are:
+//	view			the camera and view plane
+//	scene			the scene's objects (in world space), materials and lights
+//	intersector		built from the scene's objects for this frame
+//	target			resolutionX * resolutionY framebuffer (output)
+void PathTracer::render(const PathTracerView& view, const Scene& scene, const SceneIntersector& intersector, HdrFramebuffer& target)
+{
+	const unsigned numPixels = view.resolutionX * view.resolutionY;
+	if (m_numSamples > 0 && (m_accumulation.size() != numPixels || hasViewChanged(view) || m_objects.hasChanged(scene.objects)))
+		m_numSamples = 0;
+
+	if (m_numSamples == 0)
+	{
+		m_accumulation.resize(view.resolutionX, view.resolutionY);
+		m_accumulation.clear(0, numPixels);
+		m_view = view;
+		m_objects.store(scene.objects);
+	}
+
+	const float pixelWidth = (view.halfWidth * 2) / view.resolutionX, pixelHeight = (view.halfHeight * 2) / view.resolutionY;
+	const Point3D eye = view.cameraToWorld * Point3D();
+	const unsigned sample = m_numSamples, lastRow = view.resolutionY - 1;
+
+	// Each row has its own random number stream, so the result doesn't depend on how the rows are shared between threads
+	parallelFor(view.resolutionY, 4, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned j = begin; j < end; ++j)
+		{
+			Random random(sample, j);
+			const unsigned row = view.resolutionX * (lastRow - j);
+			for (unsigned i = 0; i < view.resolutionX; ++i)
+			{
+				// Jitter the ray across the pixel, so the samples average into an antialiased image
+				Vector3D direction((i + random.nextFloat()) * pixelWidth - view.halfWidth, (j + random.nextFloat()) * pixelHeight - view.halfHeight, view.distance);
+				direction.normalise();
+				m_accumulation.add(row + i, tracePath(eye, view.cameraToWorld * direction, scene, intersector, random));
+			}
+		}
+	});
+	++m_numSamples;
+
+	const float scale = 1.0f / m_numSamples;
+	parallelFor(numPixels, 4096, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned k = begin; k < end; ++k)
+			target.set(k, m_accumulation.get(k) * scale);
+	});
+}
+
+// Returns true if the camera or view plane are different from the ones the samples were taken with
+bool PathTracer::hasViewChanged(const PathTracerView& view) const
+{
+	if (view.distance != m_view.distance || view.halfWidth != m_view.halfWidth || view.halfHeight != m_view.halfHeight ||
+		view.resolutionX != m_view.resolutionX || view.resolutionY != m_view.resolutionY)
+		return true;
+
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		for (unsigned j = 0; j < 4; ++j)
+		{
+			if (view.cameraToWorld(i, j) != m_view.cameraToWorld(i, j))
+				return true;
+		}
+	}
+	return false;
+}
+
+// Follows a path from the camera through the scene, adding up the light reaching each surface it
+// bounces off, weighted by how much of it makes its way back along the path. Params:
+//	origin, direction	the ray from the camera, in world space
+//	random				the random number stream for this pixel
+Vector3D PathTracer::tracePath(Point3D origin, Vector3D direction, const Scene& scene, const SceneIntersector& intersector, Random& random) const
+{
+	Vector3D radiance, throughput(1.0f, 1.0f, 1.0f);
+	for (unsigned bounce = 0; bounce < c_maxBounces; ++bounce)
+	{
+		float distance;
+		unsigned objectIndex;
+		if (!intersector.findClosestHit(origin, direction, FLT_MAX, distance, objectIndex))
+			break;
+
+		const Object* object = scene.objects[objectIndex];
+		const Point3D position = origin + direction * distance;
+		Vector3D normal = object->getNormalAt(position);
+		if (normal.dot(direction) > 0.0f)
+			normal = normal * -1;
+		origin = position + normal * c_rayBias;
+
+		// Mirror reflection, chosen with a probability of the reflectivity so its weight cancels out
+		const unsigned material = object->m_material;
+		if (random.nextFloat() < scene.materials.reflectivity(material))
+		{
+			direction = direction - normal * (2.0f * normal.dot(direction));
+			continue;
+		}
+
+		// Diffuse: light arriving directly from the lights, then a bounce in a random direction,
+		// picked in proportion to the cosine so that only the albedo is left in the weight
+		const Vector3D albedo = ColourToVector(scene.materials.colour(material)) * min(1.0f, scene.materials.diffuse(material));
+		const Vector3D direct = sampleLights(origin, normal, scene, intersector);
+		radiance = radiance + Vector3D(throughput.x * albedo.x * direct.x, throughput.y * albedo.y * direct.y, throughput.z * albedo.z * direct.z);
+		throughput = Vector3D(throughput.x * albedo.x, throughput.y * albedo.y, throughput.z * albedo.z);
+		direction = sampleCosineHemisphere(normal, random);
+
+		// Russian roulette: end dim paths early, boosting the ones that survive to keep the average the same
+		if (bounce + 1 >= c_minBounces)
+		{
+			const float survival = min(0.95f, max(throughput.x, max(throughput.y, throughput.z)));
+			if (random.nextFloat() >= survival)
+				break;
+			throughput = throughput * (1.0f / survival);
+		}
+	}
+	return radiance;
+}
+
+// Adds up the light reaching a surface point directly from each light that isn't blocked. The
+// lights are points and directions, so each needs just one shadow ray. Params:
+//	position	the surface point, already moved off the surface, in world space
+//	normal		the surface normal on the side the path arrived from
+Vector3D PathTracer::sampleLights(const Point3D& position, const Vector3D& normal, const Scene& scene, const SceneIntersector& intersector) const
+{
+	const LightList& lights = scene.lights;
+	Vector3D light;
+	for (unsigned l = 0; l < lights.size(); ++l)
+	{
+		Vector3D toLight;
+		float distance = FLT_MAX, attenuation = 1.0f;
+		if (lights.type(l) == LightSource::Type::Point)
+		{
+			// The same smooth falloff to zero at the range as the Phong shading
+			toLight = lights.position(l) - position;
+			const float distanceSquared = toLight.dot(toLight), rangeSquared = lights.range(l) * lights.range(l);
+			if (distanceSquared >= rangeSquared)
+				continue;
+			const float falloff = 1.0f - distanceSquared / rangeSquared;
+			attenuation = falloff * falloff;
+			distance = sqrtf(distanceSquared);
+			toLight = toLight * (1.0f / distance);
+		}
+		else
+		{
+			toLight = lights.direction(l) * -1;
+			toLight.normalise();
+		}
+
+		const float cosine = normal.dot(toLight);
+		if (cosine <= 0.0f || intersector.isOccluded(position, toLight, distance))
+			continue;
+		light = light + ColourToVector(lights.colour(l)) * (lights.intensity(l) * cosine * attenuation);
+	}
+	return light;
+}
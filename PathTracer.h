@@ -0,0 +1,83 @@
+#pragma once
+#include "SceneIntersector.h"
+#include "ObjectSnapshot.h"
+#include "Shading.h"
+#include "Scene.h"
+#include "HdrFramebuffer.h"
+#include <vector>
+
+// A small, fast random number generator (PCG32). Each generator can be given its own stream,
+// so that threads working on different pixels never share or repeat random numbers.
+class Random
+{
+public:
+	Random(unsigned long long seed, unsigned long long stream)
+	{
+		m_increment = (stream << 1) | 1;
+		next();
+		m_state += seed;
+		next();
+	}
+
+	// Gets a random 32 bit number
+	unsigned next()
+	{
+		const unsigned long long old = m_state;
+		m_state = old * 6364136223846793005ULL + m_increment;
+		const unsigned xorShifted = static_cast<unsigned>(((old >> 18) ^ old) >> 27), rotation = static_cast<unsigned>(old >> 59);
+		return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+	}
+
+	// Gets a random number in [0, 1)
+	float nextFloat() { return (next() >> 8) * (1.0f / (1 << 24)); }
+
+private:
+	unsigned long long m_state = 0;
+	unsigned long long m_increment = 1;
+};
+
+// The view the path tracer renders, in world space
+struct PathTracerView
+{
+	AffineMatrix3D	cameraToWorld;
+	float			distance = 1.0f;					// Distance from the camera to the view plane
+	float			halfWidth = 1.0f, halfHeight = 1.0f;	// Half extents of the view plane
+	unsigned		resolutionX = 0, resolutionY = 0;
+};
+
+// A progressive Monte Carlo path tracer, for reference renders of the same scenes the Phong
+// shading draws. Each call to render() traces one more path through every pixel and adds it to
+// a floating point accumulation buffer, so the image converges over successive frames; the
+// buffer starts again whenever the view or any object changes.
+//
+// Surfaces are diffuse, with their material's colour as the albedo, and reflect a mirror ray
+// instead with a probability of their reflectivity. The point and directional lights are
+// sampled directly at every bounce with a shadow ray. Lights are scaled so that a white light
+// shining straight onto a white surface gives it full brightness, like the Phong shading.
+// Paths end when they leave the scene, or by Russian roulette once they are a few bounces long.
+class PathTracer
+{
+public:
+	// Adds a sample to every pixel, and writes the average of the samples so far into the framebuffer
+	void render(const PathTracerView& view, const Scene& scene, const SceneIntersector& intersector, HdrFramebuffer& target);
+
+	// Throws away the accumulated samples, e.g. after changing the lights or materials
+	void reset() { m_numSamples = 0; }
+
+	// Number of samples accumulated in each pixel
+	unsigned getNumSamples() const { return m_numSamples; }
+
+	// Number of bounces before Russian roulette starts, and the most a path can ever make
+	static const unsigned c_minBounces = 3;
+	static const unsigned c_maxBounces = 16;
+
+private:
+	bool		hasViewChanged(const PathTracerView& view) const;
+	Vector3D	tracePath(Point3D origin, Vector3D direction, const Scene& scene, const SceneIntersector& intersector, Random& random) const;
+	Vector3D	sampleLights(const Point3D& position, const Vector3D& normal, const Scene& scene, const SceneIntersector& intersector) const;
+
+	HdrFramebuffer			m_accumulation;		// Sum of the samples in each pixel
+	unsigned				m_numSamples = 0;
+	PathTracerView			m_view;				// The view the samples are for
+	ObjectSnapshot			m_objects;			// Where the objects were when the samples were taken
+};
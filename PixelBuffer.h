@@ -1,52 +1,194 @@
 #pragma once
 #include "stdafx.h"
-
-class Object;
-
-// Structure holding an Object pointer and a float value to represent depth
-struct ObjectInfo
-{
-	const Object* object;
-	float distanceToIntersection;	// Distance along the ray from the origin of the intersection point
-	//Point3D intersectionPoint; //Point of intersecction
-	Vector3D hitNormal;
-
-	ObjectInfo(const Object* obj = nullptr, float d = FLT_MAX, Vector3D n=0)
-		: object(obj), distanceToIntersection(d), hitNormal(n) {}
-};
+#include "Vector3D.h"
+#include "AlignedAllocator.h"
+#include <emmintrin.h>
 
 // Class to store information about the closest object to each pixel in a grid.
+// Each kind of information is kept in its own plane, so that the per-frame clear and the
+// visibility pass only touch the data they need:
+//	- the index of the closest object in the scene's object list (32 bits)
+//	- the distance along the ray to the intersection (32 bit float)
+//	- optionally, the surface normal at the intersection, octahedral encoded into 2 x 16 bits
+//
+// The planes are stored in square tiles of c_tileSize x c_tileSize pixels, with the tiles in
+// row order and the pixels inside each tile in Z-order (Morton order), so that pixels which are
+// close together on screen are close together in memory whichever direction they are walked in.
+// The grid is padded up to a whole number of tiles, so any width and height can be stored.
 class PixelBuffer
 {
 public:
-	// Initialises the buffer to the given dimensions
-	void init(unsigned width, unsigned height)
+	// Object index stored for pixels that don't see any object
+	static const unsigned c_noObject = 0xFFFFFFFFu;
+
+	// Size of the square tiles the pixels are stored in (8, so coordinates within a tile fit the 3 bit Morton helpers)
+	static const unsigned c_tileSize = 8;
+	static const unsigned c_tileShift = 3;
+	static const unsigned c_pixelsPerTile = c_tileSize * c_tileSize;
+
+	// Position of a pixel, both in the grid and in storage
+	struct Pixel
+	{
+		unsigned index;		// Index into the planes
+		unsigned i, j;		// Pixel x, y coordinates
+	};
+
+	// Iterator that visits the pixels of a range of tiles in storage order,
+	// skipping the padding outside the grid
+	class Iterator
+	{
+	public:
+		Iterator(const PixelBuffer& buffer, unsigned tile) : m_buffer(&buffer), m_index(tile * c_pixelsPerTile) { skipPadding(); }
+
+		Pixel operator*() const { return m_pixel; }
+		bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+		Iterator& operator++()
+		{
+			++m_index;
+			skipPadding();
+			return *this;
+		}
+
+	private:
+		// Find the coordinates of the current pixel, moving on if it's outside the grid
+		void skipPadding()
+		{
+			const unsigned end = m_buffer->m_tilesX * m_buffer->m_tilesY * c_pixelsPerTile;
+			for (; m_index < end; ++m_index)
+			{
+				const unsigned tile = m_index >> (2 * c_tileShift), morton = m_index & (c_pixelsPerTile - 1);
+				m_pixel.i = ((tile % m_buffer->m_tilesX) << c_tileShift) + compactBits(morton);
+				m_pixel.j = ((tile / m_buffer->m_tilesX) << c_tileShift) + compactBits(morton >> 1);
+				if (m_pixel.i < m_buffer->m_width && m_pixel.j < m_buffer->m_height)
+					break;
+			}
+			m_pixel.index = m_index;
+		}
+
+		const PixelBuffer* m_buffer;
+		unsigned m_index;
+		Pixel m_pixel;
+	};
+
+	// Initialises the buffer to the given dimensions, optionally with a plane for surface normals
+	void init(unsigned width, unsigned height, bool storeNormals = false)
 	{
 		m_width = width;
 		m_height = height;
-		m_pixels.resize(m_width * m_height);
+		m_tilesX = (width + c_tileSize - 1) >> c_tileShift;
+		m_tilesY = (height + c_tileSize - 1) >> c_tileShift;
+
+		// Whole tiles are always a multiple of four pixels, so the planes can be cleared four at a time
+		const unsigned size = m_tilesX * m_tilesY * c_pixelsPerTile;
+		m_objectIndices.resize(size);
+		m_depths.resize(size);
+		m_normals.resize(storeNormals ? size : 0);
 		clear();
 	}
 
-	bool isInitialised() const { return !m_pixels.empty(); }
+	bool isInitialised() const { return !m_depths.empty(); }
+	bool hasNormals() const { return !m_normals.empty(); }
 
 	unsigned width() const { return m_width; }
 	unsigned height() const { return m_height; }
+	unsigned tilesX() const { return m_tilesX; }
+	unsigned tilesY() const { return m_tilesY; }
+
+	// Iterate over every pixel, or the pixels of one tile, in storage order
+	Iterator begin() const { return Iterator(*this, 0); }
+	Iterator end() const { return Iterator(*this, m_tilesX * m_tilesY); }
+	Iterator beginTile(unsigned tileX, unsigned tileY) const { return Iterator(*this, tileX + m_tilesX * tileY); }
+	Iterator endTile(unsigned tileX, unsigned tileY) const { return Iterator(*this, tileX + m_tilesX * tileY + 1); }
 
-	// Get/set the object info for the pixel with the given indices
-	const ObjectInfo&	getObjectInfoForPixel(unsigned i, unsigned j) const { return m_pixels[i + m_height * j]; }
-	void				setObjectInfoForPixel(unsigned i, unsigned j, const ObjectInfo& value) { m_pixels[i + m_height * j] = value; }
+	// Get the storage index of the pixel with the given coordinates
+	unsigned indexOf(unsigned i, unsigned j) const
+	{
+		const unsigned tile = (i >> c_tileShift) + m_tilesX * (j >> c_tileShift);
+		return (tile << (2 * c_tileShift)) | spreadBits(i & (c_tileSize - 1)) | (spreadBits(j & (c_tileSize - 1)) << 1);
+	}
+
+	// Get/set the closest object and its distance for the pixel with the given indices
+	unsigned	getObjectIndex(unsigned i, unsigned j) const { return m_objectIndices[indexOf(i, j)]; }
+	float		getDepth(unsigned i, unsigned j) const { return m_depths[indexOf(i, j)]; }
+	void		setPixel(unsigned i, unsigned j, unsigned objectIndex, float depth)
+	{
+		const unsigned index = indexOf(i, j);
+		m_objectIndices[index] = objectIndex;
+		m_depths[index] = depth;
+	}
+
+	// The same, using a storage index (from indexOf() or an Iterator)
+	unsigned	getObjectIndexAt(unsigned index) const { return m_objectIndices[index]; }
+	float		getDepthAt(unsigned index) const { return m_depths[index]; }
 
-	// Resets the buffer to the default values, maintaining its size
+	// Get/set the (unit length) surface normal for the pixel with the given indices.
+	// Only valid if the buffer was initialised with normals, and for pixels that see an object.
+	Vector3D	getNormal(unsigned i, unsigned j) const { return decodeNormal(m_normals[indexOf(i, j)]); }
+	void		setNormal(unsigned i, unsigned j, const Vector3D& normal) { m_normals[indexOf(i, j)] = encodeNormal(normal); }
+	Vector3D	getNormalAt(unsigned index) const { return decodeNormal(m_normals[index]); }
+	void		setNormalAt(unsigned index, const Vector3D& normal) { m_normals[index] = encodeNormal(normal); }
+
+	// Resets the object and depth planes to the default values, maintaining the buffer's size.
+	// The normal plane isn't cleared, as it is only read where there is an object.
 	void clear()
 	{
-		static const ObjectInfo clearValue = ObjectInfo();
-		std::fill(m_pixels.begin(), m_pixels.end(), clearValue);
+		const __m128 clearDepth = _mm_set1_ps(FLT_MAX);
+		const __m128i clearIndex = _mm_set1_epi32(static_cast<int>(c_noObject));
+		float* depths = m_depths.data();
+		unsigned* indices = m_objectIndices.data();
+		for (size_t k = 0, n = m_depths.size(); k < n; k += 4)
+		{
+			_mm_store_ps(depths + k, clearDepth);
+			_mm_store_si128(reinterpret_cast<__m128i*>(indices + k), clearIndex);
+		}
+	}
+
+	// Packs a unit vector into 32 bits by projecting it onto an octahedron, unfolding the
+	// octahedron onto a square, and storing the 2D position as two 16 bit signed values
+	static unsigned encodeNormal(const Vector3D& n)
+	{
+		const float invL1 = 1.0f / (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+		float u = n.x * invL1, v = n.y * invL1;
+		if (n.z < 0.0f)
+		{
+			// Fold the lower half of the octahedron over the upper half's diagonals
+			const float foldedU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+			const float foldedV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+			u = foldedU;
+			v = foldedV;
+		}
+
+		const short encodedU = static_cast<short>(floorf(u * 32767.0f + 0.5f)),
+			encodedV = static_cast<short>(floorf(v * 32767.0f + 0.5f));
+		return static_cast<unsigned short>(encodedU) | (static_cast<unsigned>(static_cast<unsigned short>(encodedV)) << 16);
+	}
+
+	// Unpacks a normal stored by encodeNormal()
+	static Vector3D decodeNormal(unsigned encoded)
+	{
+		const float u = static_cast<short>(encoded & 0xFFFF) / 32767.0f,
+			v = static_cast<short>(encoded >> 16) / 32767.0f;
+		Vector3D n(u, v, 1.0f - fabsf(u) - fabsf(v));
+		if (n.z < 0.0f)
+		{
+			n.x = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+			n.y = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		}
+		n.normalise();
+		return n;
 	}
 
 private:
+	// Spread the bits of a 3 bit coordinate out to every other bit (abc -> a0b0c), and back again
+	static unsigned spreadBits(unsigned x) { return (x & 1) | ((x & 2) << 1) | ((x & 4) << 2); }
+	static unsigned compactBits(unsigned x) { return (x & 1) | ((x >> 1) & 2) | ((x >> 2) & 4); }
+
 	unsigned m_width = 0;
 	unsigned m_height = 0;
+	unsigned m_tilesX = 0;		// Number of tiles across the grid
+	unsigned m_tilesY = 0;		// Number of tiles down the grid
 
-	std::vector<ObjectInfo> m_pixels;
-};
\ No newline at end of file
+	std::vector<unsigned, AlignedAllocator<unsigned> > m_objectIndices;
+	AlignedFloatArray m_depths;
+	std::vector<unsigned> m_normals;
+};
@@ -6,26 +6,55 @@
 class Point3D
 {
 public:
-	Point3D(float x_ = 0.0f, float y_ = 0.0f, float z_ = 0.0f) : x(x_), y(y_), z(z_), w(1.0f) {}
+	Point3D(float x_ = 0.0f, float y_ = 0.0f, float z_ = 0.0f)
+#ifdef RAYCASTER_SIMD_MATH
+		: m_simd(_mm_set_ps(1.0f, z_, y_, x_)) {}
+#else
+		: x(x_), y(y_), z(z_), w(1.0f) {}
+#endif
 
+#ifdef RAYCASTER_SIMD_MATH
+	explicit Point3D(__m128 p) : m_simd(p) {}
+
+	// Components of the point (distance along each axis), sharing storage with the SIMD register
+	union
+	{
+		__m128 m_simd;
+		struct { float x, y, z, w; };
+	};
+#else
 	// Components of the point (distance along each axis)
 	float x, y, z, w;
+#endif
 
 	// Returns the point as a vector displacement from the origin
 	Vector3D asVector() const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		return Vector3D(_mm_and_ps(m_simd, SimdMath::maskXYZ()));
+#else
 		return Vector3D(x, y, z);
+#endif
 	}
 
 	// Returns the point at the given vector displacement from this point
 	Point3D operator+(const Vector3D& vec) const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		// Adding the vector's zero w keeps this point's w
+		return Point3D(_mm_add_ps(m_simd, vec.m_simd));
+#else
 		return Point3D(x + vec.x, y + vec.y, z + vec.z);
+#endif
 	}
 
 	// Returns the vector difference between two points
 	Vector3D operator-(const Point3D& other) const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		return Vector3D(_mm_and_ps(_mm_sub_ps(m_simd, other.m_simd), SimdMath::maskXYZ()));
+#else
 		return Vector3D(x - other.x, y - other.y, z - other.z);
+#endif
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,30 @@
+#include "stdafx.h"
+#include "RayDirectionTable.h"
+
+// Fills the table with the normalised direction from the camera through the corner
+// of each view plane pixel, where pixel (i, j) is at
+// (i * pixelWidth - halfWidth, j * pixelHeight - halfHeight, distance)
+void RayDirectionTable::build(float distance, float halfWidth, float halfHeight, unsigned resolutionX, unsigned resolutionY)
+{
+	const float pixelWidth = (halfWidth * 2) / resolutionX, pixelHeight = (halfHeight * 2) / resolutionY;
+
+	m_width = resolutionX;
+	m_x.resize(resolutionX * resolutionY);
+	m_y.resize(resolutionX * resolutionY);
+	m_z.resize(resolutionX * resolutionY);
+
+	for (unsigned j = 0; j < resolutionY; ++j)
+	{
+		const float y = j * pixelHeight - halfHeight;
+		for (unsigned i = 0; i < resolutionX; ++i)
+		{
+			Vector3D rayDir(i * pixelWidth - halfWidth, y, distance);
+			rayDir.normalise();
+
+			const unsigned index = i + m_width * j;
+			m_x[index] = rayDir.x;
+			m_y[index] = rayDir.y;
+			m_z[index] = rayDir.z;
+		}
+	}
+}
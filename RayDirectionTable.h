@@ -0,0 +1,37 @@
+#pragma once
+#include "Vector3D.h"
+#include <vector>
+#include "AlignedAllocator.h"
+
+// Table of the normalised camera space directions of the primary rays through each view plane pixel.
+// The directions only depend on the view plane distance, extents and resolution, so the table
+// is built once and only rebuilt when one of those changes. The x, y and z components are
+// stored in separate aligned arrays, indexed by i + width * j.
+class RayDirectionTable
+{
+public:
+	// Fills the table for the given view plane. Params are:
+	//	distance					distance from the camera to the view plane
+	//	halfWidth, halfHeight		half extents of the view plane
+	//	resolutionX, resolutionY	number of pixels in each direction
+	void build(float distance, float halfWidth, float halfHeight, unsigned resolutionX, unsigned resolutionY);
+
+	bool isBuilt() const { return !m_x.empty(); }
+
+	// Get the direction of the ray through the pixel with the given indices
+	Vector3D getDirection(unsigned i, unsigned j) const
+	{
+		const unsigned index = i + m_width * j;
+		return Vector3D(m_x[index], m_y[index], m_z[index]);
+	}
+
+	// Direct access to each component array, e.g. for loading several directions at once
+	const float* x() const { return m_x.data(); }
+	const float* y() const { return m_y.data(); }
+	const float* z() const { return m_z.data(); }
+	unsigned width() const { return m_width; }
+
+private:
+	unsigned m_width = 0;
+	AlignedFloatArray m_x, m_y, m_z;
+};
@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "RaySorter.h"
+
+// Sorts the rays by octant and origin. Params:
+//	rays	the batch to sort; its arrays are swapped with sorted copies, so nothing is copied back
+void RaySorter::sort(SecondaryRays& rays)
+{
+	if (rays.count < 2)
+		return;
+
+	// Fit the grid around the origins
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
+	for (unsigned r = 0; r < rays.count; ++r)
+	{
+		minX = min(minX, rays.origins.x[r]);
+		minY = min(minY, rays.origins.y[r]);
+		minZ = min(minZ, rays.origins.z[r]);
+		maxX = max(maxX, rays.origins.x[r]);
+		maxY = max(maxY, rays.origins.y[r]);
+		maxZ = max(maxZ, rays.origins.z[r]);
+	}
+	const float extent = max(max(maxX - minX, maxY - minY), max(maxZ - minZ, 1e-6f));
+	const float cellsPerUnit = (c_gridSize - 1) / extent;
+
+	m_keys.resize(rays.count);
+	for (unsigned r = 0; r < rays.count; ++r)
+	{
+		const Vector3D origin((rays.origins.x[r] - minX) * cellsPerUnit, (rays.origins.y[r] - minY) * cellsPerUnit, (rays.origins.z[r] - minZ) * cellsPerUnit);
+		m_keys[r] = (static_cast<unsigned long long>(getSortKey(origin, rays.directions.getVector(r))) << 32) | r;
+	}
+	radixSort(rays.count);
+
+	m_sorted.reserve(rays.count);
+	m_sorted.count = rays.count;
+	for (unsigned k = 0; k < rays.count; ++k)
+	{
+		const unsigned r = static_cast<unsigned>(m_keys[k]);
+		m_sorted.origins.x[k] = rays.origins.x[r];
+		m_sorted.origins.y[k] = rays.origins.y[r];
+		m_sorted.origins.z[k] = rays.origins.z[r];
+		m_sorted.directions.x[k] = rays.directions.x[r];
+		m_sorted.directions.y[k] = rays.directions.y[r];
+		m_sorted.directions.z[k] = rays.directions.z[r];
+		m_sorted.pixels[k] = rays.pixels[r];
+		m_sorted.weights[k] = rays.weights[r];
+	}
+	std::swap(rays, m_sorted);
+}
+
+// Gets the key for a ray, with its origin already in grid cells
+unsigned RaySorter::getSortKey(const Vector3D& origin, const Vector3D& direction)
+{
+	const unsigned octant = (direction.x < 0.0f ? 1 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 4 : 0);
+	const unsigned x = min(static_cast<unsigned>(max(origin.x, 0.0f)), c_gridSize - 1),
+		y = min(static_cast<unsigned>(max(origin.y, 0.0f)), c_gridSize - 1),
+		z = min(static_cast<unsigned>(max(origin.z, 0.0f)), c_gridSize - 1);
+	return (octant << 27) | spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+}
+
+// Spreads the bits of a 9 bit value out to every third bit (abc -> a00b00c)
+unsigned RaySorter::spreadBits(unsigned x)
+{
+	x = (x | (x << 16)) & 0x030000FFu;
+	x = (x | (x << 8)) & 0x0300F00Fu;
+	x = (x | (x << 4)) & 0x030C30C3u;
+	x = (x | (x << 2)) & 0x09249249u;
+	return x;
+}
+
+// Sorts the first count keys by their top 32 bits, which only use the bottom 30 bits, with three
+// passes of a least significant digit radix sort on 10 bits at a time
+void RaySorter::radixSort(unsigned count)
+{
+	const unsigned c_digitBits = 10, c_numDigits = 1 << c_digitBits;
+
+	m_scratch.resize(count);
+	unsigned long long* from = m_keys.data();
+	unsigned long long* to = m_scratch.data();
+	for (unsigned shift = 32; shift < 62; shift += c_digitBits)
+	{
+		unsigned offsets[c_numDigits] = {};
+		for (unsigned k = 0; k < count; ++k)
+			++offsets[(from[k] >> shift) & (c_numDigits - 1)];
+
+		unsigned total = 0;
+		for (unsigned d = 0; d < c_numDigits; ++d)
+		{
+			const unsigned digitCount = offsets[d];
+			offsets[d] = total;
+			total += digitCount;
+		}
+
+		for (unsigned k = 0; k < count; ++k)
+			to[offsets[(from[k] >> shift) & (c_numDigits - 1)]++] = from[k];
+		std::swap(from, to);
+	}
+
+	// An odd number of passes leaves the result in the scratch array
+	if (from != m_keys.data())
+		m_keys.swap(m_scratch);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "SceneIntersector.h"
+#include <vector>
+
+// Reorders a batch of secondary rays so that rays which start close together and head the same
+// way are traced one after another, which keeps the objects and bounds they test in cache and
+// makes the candidate tests more predictable. Each ray gets a 32 bit key: the octant of its
+// direction in the top bits, then the Morton code (Z-order) of its origin, quantised to a
+// 512 x 512 x 512 grid over the batch's bounding box.
+class RaySorter
+{
+public:
+	// Sorts the rays of the batch by their keys. The outputs of the batch are not kept.
+	void sort(SecondaryRays& rays);
+
+	// Gets the sort key of a ray. Params:
+	//	origin			the ray's origin, in grid cells from the corner of the batch's bounding box
+	//	direction		the ray's direction
+	static unsigned getSortKey(const Vector3D& origin, const Vector3D& direction);
+
+	// Number of cells along each side of the origin grid
+	static const unsigned c_gridSize = 512;
+
+private:
+	void radixSort(unsigned count);
+
+	// Spread the bits of a 9 bit coordinate out to every third bit
+	static unsigned spreadBits(unsigned x);
+
+	std::vector<unsigned long long>	m_keys;		// Sort key in the top 32 bits, ray index in the bottom 32
+	std::vector<unsigned long long>	m_scratch;	// Second buffer for the radix sort passes
+	SecondaryRays					m_sorted;	// The rays in sorted order, swapped with the batch afterwards
+};
@@ -0,0 +1,13 @@
+#pragma once
+#include "Object.h"
+#include "MaterialTable.h"
+#include "LightList.h"
+#include <vector>
+
+// The contents of the scene: the objects, the materials they refer to, and the lights
+struct Scene
+{
+	std::vector<Object*>	objects;
+	MaterialTable			materials;
+	LightList				lights;
+};
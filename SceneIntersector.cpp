@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "SceneIntersector.h"
+#include <xmmintrin.h>
+
+// Gathers the bounding spheres of the objects. Params are:
+//	objects		the scene's objects, in world space; must stay alive while the intersector is used
+void SceneIntersector::build(const std::vector<Object*>& objects)
+{
+	m_objects = &objects;
+	const unsigned numObjects = static_cast<unsigned>(objects.size());
+	m_bounds.resize(numObjects);
+	for (unsigned k = 0; k < numObjects; ++k)
+		m_bounds.set(k, objects[k]->position(), fabsf(objects[k]->getMaxRadius()));
+}
+
+SceneIntersector::SimdRay::SimdRay(const Point3D& origin, const Vector3D& direction) :
+	originX(_mm_set1_ps(origin.x)), originY(_mm_set1_ps(origin.y)), originZ(_mm_set1_ps(origin.z)),
+	dirX(_mm_set1_ps(direction.x)), dirY(_mm_set1_ps(direction.y)), dirZ(_mm_set1_ps(direction.z))
+{
+}
+
+// Tests the ray against four bounding spheres at once. A sphere is passed through if the
+// ray's closest approach to its centre is within the radius, and the part of the ray inside
+// it lies between the origin and maxDistance. Objects without a size (radius 0) can't be hit.
+// Params:
+//	ray				the ray, in world space
+//	first			index of the first of the four spheres
+//	maxDistance		only objects closer than this along the ray count
+// Returns a mask with bit k set if sphere first + k is passed through
+int SceneIntersector::getCandidates(const SimdRay& ray, unsigned first, float maxDistance) const
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 toCentreX = _mm_sub_ps(_mm_loadu_ps(&m_bounds.x[first]), ray.originX),
+		toCentreY = _mm_sub_ps(_mm_loadu_ps(&m_bounds.y[first]), ray.originY),
+		toCentreZ = _mm_sub_ps(_mm_loadu_ps(&m_bounds.z[first]), ray.originZ),
+		radius = _mm_loadu_ps(&m_bounds.radius[first]);
+
+	// Distance along the ray to the closest approach, and the squared distance from the centre there
+	const __m128 tc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toCentreX, ray.dirX), _mm_mul_ps(toCentreY, ray.dirY)), _mm_mul_ps(toCentreZ, ray.dirZ));
+	const __m128 centreDist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toCentreX, toCentreX), _mm_mul_ps(toCentreY, toCentreY)), _mm_mul_ps(toCentreZ, toCentreZ));
+	const __m128 missDist2 = _mm_sub_ps(centreDist2, _mm_mul_ps(tc, tc));
+
+	const __m128 candidate = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(radius, zero), _mm_cmple_ps(missDist2, _mm_mul_ps(radius, radius))),
+		_mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(tc, radius), zero), _mm_cmplt_ps(_mm_sub_ps(tc, radius), _mm_set1_ps(maxDistance))));
+	return _mm_movemask_ps(candidate);
+}
+
+// Returns true if the ray hits any object closer than maxDistance, testing the objects
+// whose bounding spheres it passes through and stopping at the first hit.
+// Params:
+//	origin			the start of the ray, in world space
+//	direction		unit direction of the ray, in world space
+//	maxDistance		only objects closer than this along the ray count
+bool SceneIntersector::isOccluded(const Point3D& origin, const Vector3D& direction, float maxDistance) const
+{
+	const SimdRay ray(origin, direction);
+	const unsigned padded = static_cast<unsigned>(m_bounds.radius.size());
+	for (unsigned i = 0; i < padded; i += 4)
+	{
+		int mask = getCandidates(ray, i, maxDistance);
+		while (mask != 0)
+		{
+			const unsigned k = i + ((mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3);
+			mask &= mask - 1;
+
+			float distance;
+			if ((*m_objects)[k]->getIntersection(origin, direction, distance) && distance > 0.0f && distance < maxDistance)
+				return true;
+		}
+	}
+	return false;
+}
+
+// Finds the closest object hit by the ray, shortening the ray to each hit as it goes, so that
+// spheres further away than the closest hit so far are skipped.
+// Params:
+//	origin			the start of the ray, in world space
+//	direction		unit direction of the ray, in world space
+//	maxDistance		only objects closer than this along the ray count
+//	distance		distance along the ray to the closest hit (output)
+//	objectIndex		index of the object that was hit (output)
+bool SceneIntersector::findClosestHit(const Point3D& origin, const Vector3D& direction, float maxDistance, float& distance, unsigned& objectIndex) const
+{
+	const SimdRay ray(origin, direction);
+	const unsigned padded = static_cast<unsigned>(m_bounds.radius.size());
+	bool hit = false;
+	for (unsigned i = 0; i < padded; i += 4)
+	{
+		int mask = getCandidates(ray, i, maxDistance);
+		while (mask != 0)
+		{
+			const unsigned k = i + ((mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3);
+			mask &= mask - 1;
+
+			float objectDistance;
+			if ((*m_objects)[k]->getIntersection(origin, direction, objectDistance) && objectDistance > 0.0f && objectDistance < maxDistance)
+			{
+				maxDistance = objectDistance;
+				distance = objectDistance;
+				objectIndex = k;
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+
+// Traces every ray in the batch
+void SceneIntersector::traceOcclusion(OcclusionRays& rays) const
+{
+	for (unsigned r = 0; r < rays.count; ++r)
+		rays.occluded[r] = isOccluded(rays.origins.getPoint(r), rays.directions.getVector(r), rays.maxDistances[r]) ? 1 : 0;
+}
+
+// Traces every ray in the batch
+void SceneIntersector::traceClosest(SecondaryRays& rays) const
+{
+	for (unsigned r = 0; r < rays.count; ++r)
+	{
+		if (!findClosestHit(rays.origins.getPoint(r), rays.directions.getVector(r), FLT_MAX, rays.hitDistances[r], rays.hitObjects[r]))
+			rays.hitObjects[r] = SecondaryRays::c_noHit;
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include "Object.h"
+#include "Frustum.h"
+#include "Vector3DArray.h"
+#include <vector>
+#include <xmmintrin.h>
+
+// Distance to move a secondary ray's start away from the surface it leaves, so it doesn't hit that surface again
+const float c_rayBias = 1e-3f;
+
+// A batch of rays that only need to know whether anything blocks them, such as shadow rays.
+// The rays are stored as separate arrays, so their origins and directions can be transformed together.
+struct OcclusionRays
+{
+	Vector3DArray				origins;
+	Vector3DArray				directions;		// Unit length
+	std::vector<float>			maxDistances;	// Only occluders closer than this along the ray count
+	std::vector<unsigned char>	occluded;		// 1 if the ray is blocked (output)
+	unsigned					count = 0;
+
+	void clear() { count = 0; }
+
+	// Sets the number of rays, growing the arrays if needed, so they can be filled in any order
+	void resize(unsigned n)
+	{
+		if (n > maxDistances.size())
+		{
+			origins.resize(n);
+			directions.resize(n);
+			maxDistances.resize(n);
+			occluded.resize(n);
+		}
+		count = n;
+	}
+
+	// Adds a ray to the batch, growing the arrays if needed
+	void add(const Point3D& origin, const Vector3D& direction, float maxDistance)
+	{
+		if (count == maxDistances.size())
+		{
+			const unsigned capacity = max(64u, count * 2);
+			origins.resize(capacity);
+			directions.resize(capacity);
+			maxDistances.resize(capacity);
+			occluded.resize(capacity);
+		}
+		origins.setPoint(count, origin);
+		directions.setVector(count, direction);
+		maxDistances[count] = maxDistance;
+		++count;
+	}
+};
+
+// A batch of rays that need the closest object they hit, such as reflection rays. Each ray carries
+// the tile pixel it contributes to and how much it contributes, so batches can be traced in any order.
+struct SecondaryRays
+{
+	// Object index stored for rays that don't hit anything
+	static const unsigned c_noHit = 0xFFFFFFFFu;
+
+	Vector3DArray			origins;
+	Vector3DArray			directions;		// Unit length
+	std::vector<unsigned>	pixels;			// Index of the pixel within its tile
+	std::vector<float>		weights;		// Fraction of the pixel's colour the ray carries
+	std::vector<unsigned>	hitObjects;		// Index of the closest object hit, or c_noHit (output)
+	std::vector<float>		hitDistances;	// Distance along the ray to the closest hit (output)
+	unsigned				count = 0;
+
+	void clear() { count = 0; }
+
+	// Makes room for at least the given number of rays
+	void reserve(unsigned capacity)
+	{
+		if (capacity <= pixels.size())
+			return;
+		origins.resize(capacity);
+		directions.resize(capacity);
+		pixels.resize(capacity);
+		weights.resize(capacity);
+		hitObjects.resize(capacity);
+		hitDistances.resize(capacity);
+	}
+
+	// Adds a ray to the batch, growing the arrays if needed
+	void add(const Point3D& origin, const Vector3D& direction, unsigned pixel, float weight)
+	{
+		if (count == pixels.size())
+			reserve(max(64u, count * 2));
+		origins.setPoint(count, origin);
+		directions.setVector(count, direction);
+		pixels[count] = pixel;
+		weights[count] = weight;
+		++count;
+	}
+};
+
+// Finds the objects that rays hit, for the rays that start from surfaces rather than the camera.
+// The objects' bounding spheres are kept in world space as separate arrays, so each ray is tested
+// against four of them at a time, and only the objects whose spheres it passes through are tested
+// exactly. The camera builds this once per frame and shares it between all kinds of secondary ray.
+class SceneIntersector
+{
+public:
+	// Gathers the bounding spheres of the objects, which must be in world space
+	void build(const std::vector<Object*>& objects);
+
+	// Returns true if the ray hits any object closer than maxDistance, stopping at the first one found
+	bool isOccluded(const Point3D& origin, const Vector3D& direction, float maxDistance) const;
+
+	// Sets the occluded flag of every ray in the batch
+	void traceOcclusion(OcclusionRays& rays) const;
+
+	// Finds the closest object the ray hits before maxDistance. Returns false if it doesn't hit anything,
+	// otherwise sets the distance to the hit and the index of the object.
+	bool findClosestHit(const Point3D& origin, const Vector3D& direction, float maxDistance, float& distance, unsigned& objectIndex) const;
+
+	// Sets the closest hit of every ray in the batch
+	void traceClosest(SecondaryRays& rays) const;
+
+	const std::vector<Object*>& getObjects() const { return *m_objects; }
+	const BoundingSpheres& getBounds() const { return m_bounds; }
+
+private:
+	// A ray's origin and direction, with each component broadcast across a register
+	struct SimdRay
+	{
+		__m128 originX, originY, originZ, dirX, dirY, dirZ;
+		SimdRay(const Point3D& origin, const Vector3D& direction);
+	};
+
+	int getCandidates(const SimdRay& ray, unsigned first, float maxDistance) const;
+
+	const std::vector<Object*>*	m_objects = nullptr;
+	BoundingSpheres				m_bounds;
+};
@@ -0,0 +1,158 @@
+#include "stdafx.h"
+#include "Shading.h"
+
+// Converts an 8 bit colour to red, green and blue values from 0 to 1
+Vector3D ColourToVector(Colour c) {
+	const float scale = 1.0f / 255.0f;
+	return Vector3D(c.r * scale, c.g * scale, c.b * scale);
+}
+
+// Converts red, green and blue values to an 8 bit colour, clamping them to the range 0 to 1.
+// Whole frames are converted in bulk by HdrFramebuffer::resolve(); this is for single pixels.
+Colour VectorToColour(const Vector3D& v) {
+	return Colour(
+		static_cast<unsigned char>(min(1.0f, max(0.0f, v.x)) * 255.0f + 0.5f),
+		static_cast<unsigned char>(min(1.0f, max(0.0f, v.y)) * 255.0f + 0.5f),
+		static_cast<unsigned char>(min(1.0f, max(0.0f, v.z)) * 255.0f + 0.5f));
+}
+
+// Works out the per-frame lighting values. Params are:
+//	lights			the lights shining on the scene, in world space
+//	worldToCamera	the transform taking world space to the camera space that pixels are shaded in
+void ShadingContext::prepare(const LightList& lights, const AffineMatrix3D& worldToCamera)
+{
+	numLights = lights.size();
+	x.resize(numLights);
+	y.resize(numLights);
+	z.resize(numLights);
+	isPoint.resize(numLights);
+	rangeSquared.resize(numLights);
+	colour.resize(numLights);
+
+	for (unsigned l = 0; l < numLights; ++l)
+	{
+		if (lights.type(l) == LightSource::Type::Point)
+		{
+			const Point3D position = worldToCamera * lights.position(l);
+			x[l] = position.x;
+			y[l] = position.y;
+			z[l] = position.z;
+			isPoint[l] = 1;
+			rangeSquared[l] = lights.range(l) * lights.range(l);
+		}
+		else
+		{
+			// The light's direction points away from the light, so flip it
+			Vector3D toLight = worldToCamera * (lights.direction(l) * -1);
+			toLight.normalise();
+			x[l] = toLight.x;
+			y[l] = toLight.y;
+			z[l] = toLight.z;
+			isPoint[l] = 0;
+			rangeSquared[l] = FLT_MAX;
+		}
+
+		//Gets current light colour and converts to vector format (rgb = xyz)
+		colour[l] = ColourToVector(lights.colour(l)) * lights.intensity(l);
+	}
+}
+
+namespace
+{
+	// Raises R DOT V to an exponent known at compile time, so the kernel is inlined into the loop over lights
+	template <unsigned N>
+	struct IntegerPower
+	{
+		float operator()(float x) const { return powInt<N>(x); }
+	};
+
+	// Sums the Phong terms over the lights, raising R DOT V to the specular exponent with power.
+	// The parameters are as for shadePhong(), with the material's constants already looked up.
+	template <typename Power>
+	Vector3D shadeLights(const ShadingContext& context, const unsigned* lights, unsigned numLights, const unsigned char* occluded,
+		float kd, float ks, float ka, const Power& power, const Point3D& position, const Vector3D& normal, const Vector3D& toViewer)
+	{
+		Vector3D phong;
+		for (unsigned k = 0; k < numLights; ++k)
+		{
+			const unsigned l = lights[k];
+			Vector3D toLight(context.x[l], context.y[l], context.z[l]);
+			float attenuation = 1.0f;
+			if (context.isPoint[l])
+			{
+				// Fade the light out smoothly, reaching zero at its range
+				toLight = toLight - position.asVector();
+				const float distanceSquared = toLight.dot(toLight);
+				if (distanceSquared >= context.rangeSquared[l])
+					continue;
+				const float falloff = 1.0f - distanceSquared / context.rangeSquared[l];
+				attenuation = falloff * falloff;
+				toLight = toLight * (1.0f / sqrtf(distanceSquared));
+			}
+
+			if (occluded != nullptr && occluded[k])
+			{
+				phong = phong + context.colour[l] * (ka * attenuation);
+				continue;
+			}
+
+			//Diffuse: L DOT N, where L is the direction to the light
+			const float lightDotNormal = normal.dot(toLight);
+			const float diffuseCoefficient = max(0.0f, lightDotNormal);
+
+			//Specular: R DOT V, where R is the direction to the light reflected in the surface
+			//R = 2(L DOT N)N - L
+			const Vector3D reflectionVector = normal * (2 * lightDotNormal) - toLight;
+			const float specularCoefficient = power(max(0.0f, reflectionVector.dot(toViewer)));
+
+			const float reflection = kd * diffuseCoefficient + ks * specularCoefficient + ka;
+			phong = phong + context.colour[l] * (reflection * attenuation);
+		}
+		return phong;
+	}
+}
+
+// Shades a point on a surface with the Phong reflection model, summed over the given lights:
+//	Colour = sum(LightColour * A * (kd * (L DOT N) + ks * (R DOT V)^n + ka)) * SurfaceColour
+// where A is 1 for directional lights, and (1 - d^2 / range^2)^2 for point lights at distance d.
+// Lights that are blocked only contribute their ambient term.
+// Params:
+//	context		the per-frame lighting values
+//	lights		indices of the lights that may reach the point
+//	numLights	number of light indices
+//	occluded	one flag per light index, 1 if something blocks the light; null if nothing does
+//	materials	the scene's materials, which supply kd, ks, ka, n and the surface colour
+//	material	index of the surface's material
+//	position	the point being shaded, in camera space
+//	normal		unit surface normal at the point, in camera space
+//	toViewer	unit vector from the point towards the camera
+// Returns the shaded colour, with 1 as full white. It isn't clamped, so bright highlights are kept
+// until the frame is tone mapped.
+Vector3D shadePhong(const ShadingContext& context, const unsigned* lights, unsigned numLights, const unsigned char* occluded,
+	const MaterialTable& materials, unsigned material, const Point3D& position, const Vector3D& normal, const Vector3D& toViewer)
+{
+	const float kd = materials.diffuse(material), ks = materials.specular(material), ka = materials.ambient(material);
+	const SpecularPower& specularPower = materials.specularPower(material);
+
+	// Pick the loop for the material's exponent once, rather than calling its kernel through a pointer for every light.
+	// The common exponents get their own copy of the loop; the rest go through SpecularPower.
+	Vector3D phong;
+	switch (specularPower.getIntegerExponent())
+	{
+	case 1:  phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<1>(), position, normal, toViewer); break;
+	case 2:  phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<2>(), position, normal, toViewer); break;
+	case 4:  phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<4>(), position, normal, toViewer); break;
+	case 5:  phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<5>(), position, normal, toViewer); break;
+	case 8:  phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<8>(), position, normal, toViewer); break;
+	case 10: phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<10>(), position, normal, toViewer); break;
+	case 16: phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<16>(), position, normal, toViewer); break;
+	case 20: phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<20>(), position, normal, toViewer); break;
+	case 32: phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<32>(), position, normal, toViewer); break;
+	case 64: phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, IntegerPower<64>(), position, normal, toViewer); break;
+	default: phong = shadeLights(context, lights, numLights, occluded, kd, ks, ka, specularPower, position, normal, toViewer); break;
+	}
+
+	// Combine the shading with the surface colour
+	const Vector3D surfaceColour = ColourToVector(materials.colour(material));
+	return Vector3D(phong.x * surfaceColour.x, phong.y * surfaceColour.y, phong.z * surfaceColour.z);
+}
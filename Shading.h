@@ -0,0 +1,27 @@
+#pragma once
+#include "AffineMatrix3D.h"
+#include "Object.h"
+#include "MaterialTable.h"
+#include "LightList.h"
+#include <vector>
+
+// Converts between 8 bit colours and vectors for shading calculations, where 1 is full brightness
+Vector3D ColourToVector(Colour c);
+Colour VectorToColour(const Vector3D& v);
+
+// The lighting values that are the same for every pixel, worked out once per frame
+// from the scene's lights and the camera so that shadePhong() only has to do the per-pixel terms.
+// The lights are kept in camera space, with each property in its own array.
+struct ShadingContext
+{
+	std::vector<float>			x, y, z;		// Unit vector towards a directional light, or the position of a point light
+	std::vector<unsigned char>	isPoint;		// 1 for point lights, 0 for directional lights
+	std::vector<float>			rangeSquared;	// Squared range of point lights
+	std::vector<Vector3D>		colour;			// Light colour scaled by its intensity
+	unsigned					numLights = 0;
+
+	void prepare(const LightList& lights, const AffineMatrix3D& worldToCamera);
+};
+
+Vector3D shadePhong(const ShadingContext& context, const unsigned* lights, unsigned numLights, const unsigned char* occluded,
+	const MaterialTable& materials, unsigned material, const Point3D& position, const Vector3D& normal, const Vector3D& toViewer);
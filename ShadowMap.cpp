@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "ShadowMap.h"
+#include "ParallelFor.h"
+
+// Rebuilds the map if needed. Params are:
+//	lightDirection	direction the light travels in, in world space
+//	intersector		the objects (in world space) and their bounds, built for this frame
+bool ShadowMap::update(const Vector3D& lightDirection, const SceneIntersector& intersector)
+{
+	Vector3D direction = lightDirection;
+	direction.normalise();
+
+	const std::vector<Object*>& objects = intersector.getObjects();
+	if (m_isValid && direction.x == m_direction.x && direction.y == m_direction.y && direction.z == m_direction.z && !m_objects.hasChanged(objects))
+		return false;
+
+	// Pick two axes at right angles to the light, starting from whichever world axis is least parallel to it
+	m_direction = direction;
+	const Vector3D helper = fabsf(direction.y) < 0.9f ? Vector3D(0.0f, 1.0f, 0.0f) : Vector3D(1.0f, 0.0f, 0.0f);
+	m_axisU = helper.cross(direction);
+	m_axisU.normalise();
+	m_axisV = direction.cross(m_axisU);
+
+	// Fit the map around the bounding spheres of the objects
+	const BoundingSpheres& bounds = intersector.getBounds();
+	float maxU = -FLT_MAX, maxV = -FLT_MAX;
+	m_minU = m_minV = m_minDepth = FLT_MAX;
+	for (unsigned k = 0; k < bounds.count; ++k)
+	{
+		if (bounds.radius[k] <= 0.0f)
+			continue;
+		const Vector3D centre(bounds.x[k], bounds.y[k], bounds.z[k]);
+		const float u = centre.dot(m_axisU), v = centre.dot(m_axisV), depth = centre.dot(m_direction);
+		m_minU = min(m_minU, u - bounds.radius[k]);
+		m_minV = min(m_minV, v - bounds.radius[k]);
+		m_minDepth = min(m_minDepth, depth - bounds.radius[k]);
+		maxU = max(maxU, u + bounds.radius[k]);
+		maxV = max(maxV, v + bounds.radius[k]);
+	}
+
+	m_depths.assign(m_resolution * m_resolution, FLT_MAX);
+	if (maxU > m_minU)
+	{
+		// Square texels, covering the larger of the two extents
+		m_texelsPerUnit = m_resolution / max(maxU - m_minU, maxV - m_minV);
+		m_minDepth -= 1.0f;
+
+		// Trace a ray along the light's direction from the centre of each texel. Each texel only
+		// writes its own depth, so the rows are shared out between the threads.
+		const float unitsPerTexel = 1.0f / m_texelsPerUnit;
+		parallelFor(m_resolution, 1, [&](unsigned begin, unsigned end)
+		{
+			for (unsigned j = begin; j < end; ++j)
+			{
+				for (unsigned i = 0; i < m_resolution; ++i)
+				{
+					const float u = m_minU + (i + 0.5f) * unitsPerTexel, v = m_minV + (j + 0.5f) * unitsPerTexel;
+					const Point3D origin = Point3D() + m_axisU * u + m_axisV * v + m_direction * m_minDepth;
+
+					float distance;
+					unsigned objectIndex;
+					if (intersector.findClosestHit(origin, m_direction, FLT_MAX, distance, objectIndex))
+						m_depths[i + m_resolution * j] = distance;
+				}
+			}
+		});
+	}
+
+	m_objects.store(objects);
+	m_isValid = true;
+	++m_buildCount;
+	return true;
+}
+
+// Looks up the texel under the point, and compares the point's distance from the map's plane with the stored depth.
+// Params:
+//	point	the point to test, in world space
+bool ShadowMap::isOccluded(const Point3D& point) const
+{
+	const Vector3D p = point.asVector();
+	const float u = (p.dot(m_axisU) - m_minU) * m_texelsPerUnit, v = (p.dot(m_axisV) - m_minV) * m_texelsPerUnit;
+	if (u < 0.0f || v < 0.0f || u >= m_resolution || v >= m_resolution)
+		return false;
+
+	const float depth = p.dot(m_direction) - m_minDepth;
+	return depth > m_depths[static_cast<unsigned>(u) + m_resolution * static_cast<unsigned>(v)] + m_depthBias;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "SceneIntersector.h"
+#include "ObjectSnapshot.h"
+#include <vector>
+
+// A depth map of the scene as seen from a directional light, so that shadow queries can be
+// answered with a lookup instead of a ray. The map is an orthographic view along the light's
+// direction, covering the bounding spheres of every object, and each texel holds the distance
+// from the map's plane to the first object along the light's direction.
+// Building the map traces one ray per texel, so it is kept until the light's direction changes
+// or an object moves, and is only rebuilt then.
+class ShadowMap
+{
+public:
+	// Number of texels along each side of the map
+	unsigned	getResolution() const { return m_resolution; }
+	void		setResolution(unsigned resolution) { m_resolution = max(1u, resolution); m_isValid = false; }
+
+	// Distance a point must be behind the stored depth to count as shadowed, to stop surfaces shadowing themselves
+	float		getDepthBias() const { return m_depthBias; }
+	void		setDepthBias(float bias) { m_depthBias = bias; }
+
+	// Rebuilds the map if the light or any of the objects have changed since it was last built.
+	// Returns true if it was rebuilt.
+	bool		update(const Vector3D& lightDirection, const SceneIntersector& intersector);
+
+	// Returns true if the world space point is shadowed from the light
+	bool		isOccluded(const Point3D& point) const;
+
+	// Number of times the map has been built
+	unsigned	getBuildCount() const { return m_buildCount; }
+
+private:
+	unsigned	m_resolution = 512;
+	float		m_depthBias = 0.05f;
+
+	// The map's orientation and extent
+	Vector3D	m_direction;			// Unit direction the light travels in
+	Vector3D	m_axisU, m_axisV;		// Unit vectors along the map's edges, at right angles to the light
+	float		m_minU = 0.0f, m_minV = 0.0f, m_minDepth = 0.0f;	// World space position of the map's corner, along each axis
+	float		m_texelsPerUnit = 1.0f;
+	std::vector<float>	m_depths;		// Distance to the first object from each texel, or FLT_MAX
+
+	// The state the map was built for
+	bool				m_isValid = false;
+	ObjectSnapshot		m_objects;			// Where the objects were
+	unsigned			m_buildCount = 0;
+};
@@ -0,0 +1,40 @@
+#include "stdafx.h"
+#include "SpecularPower.h"
+
+// Chooses how to raise values to the given exponent. Params are:
+//	exponent	the specular exponent; non-negative, but need not be a whole number
+void SpecularPower::setExponent(float exponent)
+{
+	if (exponent == m_exponent)
+		return;
+
+	m_exponent = exponent;
+	m_maxError = 0.0f;
+	if (exponent >= 0.0f && exponent <= c_maxIntegerExponent && exponent == floorf(exponent))
+	{
+		m_integerPower = getIntegerPowers(std::make_integer_sequence<unsigned, c_maxIntegerExponent + 1>())[static_cast<unsigned>(exponent)];
+		m_table.clear();
+		return;
+	}
+
+	m_integerPower = nullptr;
+	m_table.resize(c_tableSize + 1);
+	for (unsigned k = 0; k <= c_tableSize; ++k)
+		m_table[k] = static_cast<float>(pow(static_cast<double>(k) / c_tableSize, static_cast<double>(exponent)));
+
+	// The interpolation error is largest between entries, so measure it at several points in each interval
+	const unsigned samplesPerInterval = 8;
+	for (unsigned k = 0; k < c_tableSize * samplesPerInterval; ++k)
+	{
+		const double x = (k + 0.5) / (c_tableSize * samplesPerInterval);
+		m_maxError = max(m_maxError, static_cast<float>(fabs(lookUp(static_cast<float>(x)) - pow(x, static_cast<double>(exponent)))));
+	}
+}
+
+// Gets the bound on the table's interpolation error. Params are:
+//	exponent	the specular exponent; non-negative
+double SpecularPower::getErrorBound(float exponent)
+{
+	const double n = exponent, intervalWidth = 1.0 / c_tableSize;
+	return n >= 2.0 ? n * (n - 1.0) * intervalWidth * intervalWidth / 8.0 : pow(intervalWidth, n);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include <utility>
+
+// Raises x to a power known at compile time, by squaring x^(N/2)
+template <unsigned N>
+inline float powInt(float x)
+{
+	const float half = powInt<N / 2>(x);
+	return (N & 1) ? half * half * x : half * half;
+}
+
+template <>
+inline float powInt<0>(float) { return 1.0f; }
+
+template <>
+inline float powInt<1>(float x) { return x; }
+
+// Raises values between 0 and 1 to a material's specular (shininess) exponent.
+// Whole number exponents up to c_maxIntegerExponent use a kernel specialised for that exponent;
+// any other exponent looks the result up in a table, with linear interpolation between entries.
+class SpecularPower
+{
+public:
+	// Largest exponent with its own kernel
+	static const unsigned c_maxIntegerExponent = 64;
+
+	// Number of intervals the table divides 0 to 1 into. See getErrorBound() for how far the
+	// interpolated values can be from pow().
+	static const unsigned c_tableSize = 1024;
+
+	// Returned by getIntegerExponent() when the table is used
+	static const unsigned c_noIntegerExponent = 0xFFFFFFFFu;
+
+	// Chooses the kernel or builds the table for the given exponent; does nothing if it hasn't changed
+	void setExponent(float exponent);
+
+	// Returns x^exponent, for x between 0 and 1
+	float operator()(float x) const
+	{
+		return m_integerPower != nullptr ? m_integerPower(x) : lookUp(x);
+	}
+
+	float getExponent() const { return m_exponent; }
+	bool usesTable() const { return m_integerPower == nullptr; }
+
+	// The exponent as a whole number, or c_noIntegerExponent if the table is used. Shading switches on
+	// this once per point, so the kernels for common exponents can be inlined into its loop over lights.
+	unsigned getIntegerExponent() const { return m_integerPower != nullptr ? static_cast<unsigned>(m_exponent) : c_noIntegerExponent; }
+
+	// The largest difference from pow() that interpolating the table can give, before rounding.
+	// For exponents n of 2 or more, x^n curves most at x = 1, so the error is at most n(n - 1) / (8 * c_tableSize^2),
+	// i.e. under 0.002 for exponents up to 128. Below 2, x^n curves without limit as x approaches 0,
+	// and the error is largest in the first interval, where it is at most (1 / c_tableSize)^n.
+	static double getErrorBound(float exponent);
+
+	// The largest difference from pow() over 0 to 1, measured when the table is built (0 for the integer kernels)
+	float getMaxError() const { return m_maxError; }
+
+private:
+	typedef float (*PowerFunction)(float);
+
+	// Interpolates between the two table entries either side of x
+	float lookUp(float x) const
+	{
+		const float position = (x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x)) * c_tableSize;
+		const unsigned index = static_cast<unsigned>(position) < c_tableSize ? static_cast<unsigned>(position) : c_tableSize - 1;
+		const float t = position - index;
+		return m_table[index] + t * (m_table[index + 1] - m_table[index]);
+	}
+
+	// Gets the kernel for each whole number exponent, indexed by the exponent
+	template <unsigned... N>
+	static const PowerFunction* getIntegerPowers(std::integer_sequence<unsigned, N...>)
+	{
+		static const PowerFunction powers[] = { &powInt<N>... };
+		return powers;
+	}
+
+	float				m_exponent = -1.0f;
+	PowerFunction		m_integerPower = nullptr;	// The kernel for the exponent, or null to use the table
+	std::vector<float>	m_table;					// x^exponent for x = k / c_tableSize, k = 0 to c_tableSize
+	float				m_maxError = 0.0f;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+
+// A fixed size, lock-free queue for passing items from one thread to another. Only one thread
+// may push and only one thread may pop. It holds up to Capacity - 1 items, and never allocates.
+template <typename T, unsigned Capacity>
+class SpscQueue
+{
+public:
+	// Adds an item to the back of the queue; returns false if the queue is full
+	bool push(const T& item)
+	{
+		const unsigned head = m_head.load(std::memory_order_relaxed);
+		const unsigned next = (head + 1) % Capacity;
+		if (next == m_tail.load(std::memory_order_acquire))
+			return false;
+
+		m_items[head] = item;
+		m_head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Takes the item from the front of the queue; returns false if the queue is empty
+	bool pop(T& item)
+	{
+		const unsigned tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire))
+			return false;
+
+		item = m_items[tail];
+		m_tail.store((tail + 1) % Capacity, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T m_items[Capacity];
+	// Each end is written by a different thread, so they are kept on separate cache lines
+	alignas(64) std::atomic<unsigned> m_head{ 0 };	// Where the next item is pushed
+	alignas(64) std::atomic<unsigned> m_tail{ 0 };	// Where the next item is popped from
+};
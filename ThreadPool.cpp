@@ -0,0 +1,247 @@
+#include "stdafx.h"
+#include "ThreadPool.h"
+#include <emmintrin.h>
+
+ThreadPool* ThreadPool::s_current = nullptr;
+
+namespace
+{
+	// Set on the pool's threads while they run a job, so that nested loops run directly
+	thread_local bool t_inJob = false;
+
+	// The worker's index in its pool, or 0 on threads that aren't workers
+	thread_local unsigned t_threadIndex = 0;
+
+	// Returns the number of milliseconds since the start time
+	double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+#ifdef _WIN32
+	// Gets the logical processors that make up each physical core, in the process's processor group.
+	// Returns no cores if Windows can't say.
+	std::vector<DWORD_PTR> getCoreMasks()
+	{
+		std::vector<DWORD_PTR> masks;
+		DWORD length = 0;
+		GetLogicalProcessorInformation(nullptr, &length);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (info.empty() || !GetLogicalProcessorInformation(info.data(), &length))
+			return masks;
+
+		for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& entry : info)
+		{
+			if (entry.Relationship == RelationProcessorCore)
+				masks.push_back(entry.ProcessorMask);
+		}
+		return masks;
+	}
+#endif
+}
+
+unsigned ThreadPool::getThreadIndex()
+{
+	return t_threadIndex;
+}
+
+void ThreadPool::start(unsigned numThreads)
+{
+	stop();
+	if (numThreads == 0)
+		numThreads = max(1u, std::thread::hardware_concurrency());
+
+	m_counters.assign(numThreads, ThreadCounters());
+	m_stats.assign(numThreads, ThreadPoolStats());
+	m_stopping = false;
+	m_workers.reserve(numThreads - 1);
+	const unsigned generation = m_generation.load();
+#ifdef _WIN32
+	const std::vector<DWORD_PTR> coreMasks = getCoreMasks();
+	unsigned unpinnedWorkers = 0;
+#endif
+	for (unsigned t = 1; t < numThreads; ++t)
+	{
+		// The workers are given the generation to wait for a change from, as they may not be
+		// running until after the first job has been submitted
+		m_workers.emplace_back(&ThreadPool::workerMain, this, t, generation);
+#ifdef _WIN32
+		// Give each worker a physical core of its own, leaving the first core to the submitting thread.
+		// A worker may run on any of its core's logical processors; once every core has a worker, the
+		// rest go round the cores again, sharing them through their other logical processors.
+		if (coreMasks.empty() || SetThreadAffinityMask(m_workers.back().native_handle(), coreMasks[t % coreMasks.size()]) == 0)
+			++unpinnedWorkers;
+#endif
+	}
+#ifdef _WIN32
+	if (unpinnedWorkers > 0)
+		std::cout << "Couldn't pin " << unpinnedWorkers << " of the thread pool's workers to a core; they run wherever Windows puts them" << std::endl;
+#endif
+
+	m_running = true;
+	m_frameStart = Clock::now();
+	s_current = this;
+}
+
+void ThreadPool::stop()
+{
+	if (s_current == this)
+		s_current = nullptr;
+	if (!m_running)
+		return;
+
+	// Wake every worker with a new generation that has no job
+	{
+		std::lock_guard<std::mutex> lock(m_parkMutex);
+		m_stopping = true;
+		m_generation.fetch_add(1);
+	}
+	m_wake.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+
+	m_workers.clear();
+	m_running = false;
+}
+
+// Shares a job out between the threads, and waits for it to finish. Params are:
+//	count		number of items in the range
+//	minChunk	smallest number of items worth giving to a thread
+//	task		calls the body on a range of items
+//	body		the loop body, passed to the task
+bool ThreadPool::submit(unsigned count, unsigned minChunk, Task task, const void* body)
+{
+	if (!m_running || t_inJob || m_busy.exchange(true, std::memory_order_acquire))
+		return false;
+
+	const unsigned numThreads = getNumThreads();
+	const unsigned numChunks = max(1u, min(count / max(1u, minChunk), numThreads * c_chunksPerThread));
+	m_task = task;
+	m_body = body;
+	m_count = count;
+	m_chunkSize = (count + numChunks - 1) / max(1u, numChunks);
+	m_numChunks = m_chunkSize > 0 ? (count + m_chunkSize - 1) / m_chunkSize : 0;
+
+	t_inJob = true;
+	if (m_numChunks <= 1 || m_workers.empty())
+	{
+		// Not worth waking the workers
+		const Clock::time_point start = Clock::now();
+		if (count > 0)
+			task(body, 0, count);
+		m_counters[0].busyTime += millisecondsSince(start);
+		++m_counters[0].chunks;
+	}
+	else
+	{
+		m_nextChunk.store(0, std::memory_order_relaxed);
+		m_finishedWorkers.store(0, std::memory_order_relaxed);
+		m_generation.fetch_add(1);
+
+		// Parked workers need waking; the lock makes sure none is about to park without seeing the new generation
+		if (m_parkedWorkers.load() > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_parkMutex);
+			}
+			m_wake.notify_all();
+		}
+
+		runChunks(0);
+
+		// Wait for every worker to be done with the job, not just for its chunks to be finished,
+		// so that none of them can still be reading it when the next job is set up. Spin for a
+		// while, as the workers usually finish together, then park until the last one wakes us.
+		const unsigned numWorkers = static_cast<unsigned>(m_workers.size());
+		for (unsigned spins = 0; m_finishedWorkers.load(std::memory_order_acquire) < numWorkers; ++spins)
+		{
+			if (spins < c_spinCount)
+			{
+				_mm_pause();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_doneMutex);
+			m_submitterParked = true;
+			m_done.wait(lock, [&]() { return m_finishedWorkers.load() >= numWorkers; });
+			m_submitterParked = false;
+		}
+	}
+	t_inJob = false;
+
+	m_busy.store(false, std::memory_order_release);
+	return true;
+}
+
+// Runs chunks of the current job until there are none left. Params are:
+//	thread		index of the thread running them, for its counters
+void ThreadPool::runChunks(unsigned thread)
+{
+	ThreadCounters& counters = m_counters[thread];
+	const Clock::time_point start = Clock::now();
+	for (unsigned chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed); chunk < m_numChunks; chunk = m_nextChunk.fetch_add(1, std::memory_order_relaxed))
+	{
+		const unsigned begin = chunk * m_chunkSize, end = min(m_count, begin + m_chunkSize);
+		m_task(m_body, begin, end);
+		++counters.chunks;
+	}
+	counters.busyTime += millisecondsSince(start);
+}
+
+void ThreadPool::workerMain(unsigned thread, unsigned seen)
+{
+	t_inJob = true;
+	t_threadIndex = thread;
+	for (;;)
+	{
+		// Spin for a while in case the next job comes straight away, then park until it does
+		unsigned generation = m_generation.load(std::memory_order_acquire);
+		for (unsigned spins = 0; generation == seen; generation = m_generation.load(std::memory_order_acquire))
+		{
+			if (++spins < c_spinCount)
+			{
+				_mm_pause();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_parkMutex);
+			m_parkedWorkers.fetch_add(1);
+			m_wake.wait(lock, [&]() { return m_generation.load() != seen; });
+			m_parkedWorkers.fetch_sub(1);
+		}
+		seen = generation;
+		if (m_stopping)
+			return;
+
+		runChunks(thread);
+
+		// The last worker to finish wakes the submitting thread if it has parked; the lock makes
+		// sure it isn't about to park without seeing the count
+		if (m_finishedWorkers.fetch_add(1) + 1 == m_workers.size() && m_submitterParked.load())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_doneMutex);
+			}
+			m_done.notify_one();
+		}
+	}
+}
+
+void ThreadPool::beginFrame()
+{
+	m_frameStart = Clock::now();
+	for (ThreadCounters& counters : m_counters)
+		counters = ThreadCounters();
+}
+
+void ThreadPool::endFrame()
+{
+	// Only called between jobs, so the workers aren't touching their counters
+	const double frameTime = millisecondsSince(m_frameStart);
+	for (unsigned t = 0; t < m_counters.size(); ++t)
+	{
+		m_stats[t].busyTime = m_counters[t].busyTime;
+		m_stats[t].chunks = m_counters[t].chunks;
+		m_stats[t].utilisation = frameTime > 0.0 ? static_cast<float>(m_counters[t].busyTime / frameTime) : 0.0f;
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How busy one of the pool's threads was over the last frame
+struct ThreadPoolStats
+{
+	double		busyTime = 0.0;		// Time spent running tasks (ms)
+	unsigned	chunks = 0;			// Number of chunks of work run
+	float		utilisation = 0.0f;	// Fraction of the frame spent running tasks
+};
+
+// A fixed set of worker threads that share out the parallel loops of each frame. The workers are
+// started once, spread over the physical cores, and live until stop(), so submitting work never
+// creates threads or allocates memory. Between jobs, workers spin for a short while in case more
+// work arrives straight away, then park until they are woken. The submitting thread waits for the
+// workers to finish a job in the same way.
+//
+// Only one thread submits work at a time (the one that renders); the submitting thread works on
+// the job too, and every worker has finished with the job before run() returns. Work submitted
+// from inside a job, or while another job is running, is run directly on the calling thread.
+class ThreadPool
+{
+public:
+	~ThreadPool() { stop(); }
+
+	// Starts the worker threads, making the pool the one parallelFor() uses. Params are:
+	//	numThreads		total number of threads, including the submitting one, or 0 for one per hardware thread
+	void start(unsigned numThreads = 0);
+	void stop();
+
+	bool		isRunning() const { return m_running; }
+	unsigned	getNumThreads() const { return static_cast<unsigned>(m_workers.size()) + 1; }
+
+	// Runs body(begin, end) over the range [0, count), split into chunks of at least minChunk
+	// items, and returns once every chunk is finished. Returns false without running anything if
+	// the pool can't take the job, in which case the caller should run it itself.
+	template <typename Body>
+	bool run(unsigned count, unsigned minChunk, const Body& body)
+	{
+		return submit(count, minChunk, &invoke<Body>, &body);
+	}
+
+	// Mark the start and end of a frame. endFrame() works out each thread's utilisation over the frame.
+	void beginFrame();
+	void endFrame();
+
+	// Each thread's work over the last frame; the submitting thread is first
+	const std::vector<ThreadPoolStats>&	getStats() const { return m_stats; }
+
+	// The running pool, or nullptr if there isn't one
+	static ThreadPool*	current() { return s_current; }
+
+	// Index of the calling thread: 1 onwards for the pool's workers, and 0 for any other thread, including
+	// the submitting one. Loop bodies can use it to pick their own scratch space, one per getNumThreads().
+	static unsigned		getThreadIndex();
+
+	// Number of times a waiting worker checks for work before it parks
+	static const unsigned c_spinCount = 4000;
+	// Number of chunks to aim for on each thread, so threads that finish early can take more
+	static const unsigned c_chunksPerThread = 4;
+
+private:
+	typedef void (*Task)(const void* body, unsigned begin, unsigned end);
+	typedef std::chrono::high_resolution_clock Clock;
+
+	template <typename Body>
+	static void invoke(const void* body, unsigned begin, unsigned end) { (*static_cast<const Body*>(body))(begin, end); }
+
+	bool submit(unsigned count, unsigned minChunk, Task task, const void* body);
+	void workerMain(unsigned thread, unsigned seen);
+	void runChunks(unsigned thread);
+
+	// Per-thread counters, each on its own cache line as they are written by different threads
+	struct alignas(64) ThreadCounters
+	{
+		double		busyTime = 0.0;
+		unsigned	chunks = 0;
+	};
+
+	std::vector<std::thread>	m_workers;
+	std::vector<ThreadCounters>	m_counters;		// Running totals for the current frame, one per thread
+	std::vector<ThreadPoolStats>	m_stats;	// Totals for the last frame
+	Clock::time_point			m_frameStart;
+	bool						m_running = false;
+	std::atomic<bool>			m_busy{ false };	// Set while a job is running
+
+	// The current job
+	Task						m_task = nullptr;
+	const void*					m_body = nullptr;
+	unsigned					m_count = 0, m_chunkSize = 0, m_numChunks = 0;
+	alignas(64) std::atomic<unsigned>	m_nextChunk{ 0 };
+	alignas(64) std::atomic<unsigned>	m_finishedWorkers{ 0 };	// Workers that are done with the current job
+	std::atomic<bool>			m_submitterParked{ false };	// Set while the submitting thread sleeps until the job is done
+	std::mutex					m_doneMutex;
+	std::condition_variable		m_done;						// Signalled by the last worker to finish a job
+
+	// Workers wait for the generation to change, which means there is a new job (or the pool is stopping)
+	alignas(64) std::atomic<unsigned>	m_generation{ 0 };
+	std::atomic<unsigned>		m_parkedWorkers{ 0 };
+	std::atomic<bool>			m_stopping{ false };
+	std::mutex					m_parkMutex;
+	std::condition_variable		m_wake;
+
+	static ThreadPool*			s_current;
+};
@@ -1,61 +1,150 @@
 #pragma once
 #include "Math.h"
+
+// The vector and point classes use SSE for their operations, storing their four components in
+// one 16 byte aligned register. Define RAYCASTER_SCALAR_MATH (e.g. in the project's preprocessor
+// definitions) to use the plain scalar reference implementation instead.
+#ifndef RAYCASTER_SCALAR_MATH
+#define RAYCASTER_SIMD_MATH
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+// Helpers shared by Vector3D and Point3D
+namespace SimdMath
+{
+	// Dot product of the x, y and z components, ignoring w
+	inline float dot3(__m128 a, __m128 b)
+	{
+		const __m128 product = _mm_mul_ps(a, b);
+		const __m128 y = _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1));
+		const __m128 z = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2));
+		return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(product, y), z));
+	}
+
+	// Approximate 1/sqrt(x), refined with one Newton-Raphson step to about 23 bits of precision
+	inline __m128 reciprocalSqrt(__m128 x)
+	{
+		const __m128 estimate = _mm_rsqrt_ps(x);
+		const __m128 halfXEstimate2 = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(estimate, estimate));
+		return _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), halfXEstimate2));
+	}
+
+	// Mask selecting the x, y and z lanes
+	inline __m128 maskXYZ()
+	{
+		return _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	}
+}
+#endif
+
 // A class for performing basic operations with homogeneous vectors in 3D space.
 // Feel free to edit/extend!
 class Vector3D
 {
 public:
-	Vector3D(float x_ = 0.0f, float y_ = 0.0f, float z_ = 0.0f) : x(x_), y(y_), z(z_), w(0.0f) {}
+	Vector3D(float x_ = 0.0f, float y_ = 0.0f, float z_ = 0.0f)
+#ifdef RAYCASTER_SIMD_MATH
+		: m_simd(_mm_set_ps(0.0f, z_, y_, x_)) {}
+#else
+		: x(x_), y(y_), z(z_), w(0.0f) {}
+#endif
+
+#ifdef RAYCASTER_SIMD_MATH
+	explicit Vector3D(__m128 v) : m_simd(v) {}
 
+	// Components of the vector, sharing storage with the SIMD register
+	union
+	{
+		__m128 m_simd;
+		struct { float x, y, z, w; };
+	};
+#else
 	float x, y, z, w;
+#endif
 
 	// Get the length of the vector
 	float magnitude() const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(SimdMath::dot3(m_simd, m_simd))));
+#else
 		return sqrt(x * x + y * y + z * z);
+#endif
 	}
 
 	// Make the vector unit length
 	void normalise()
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		// Scale x, y and z by the reciprocal length, leaving w unchanged
+		const __m128 invMag = SimdMath::reciprocalSqrt(_mm_set1_ps(SimdMath::dot3(m_simd, m_simd)));
+		const __m128 mask = SimdMath::maskXYZ();
+		m_simd = _mm_or_ps(_mm_and_ps(mask, _mm_mul_ps(m_simd, invMag)), _mm_andnot_ps(mask, m_simd));
+#else
 		float mag = magnitude();
 		x /= mag;
 		y /= mag;
 		z /= mag;
+#endif
 	}
 
 	// Vector dot product
 	float dot(const Vector3D& other) const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		return SimdMath::dot3(m_simd, other.m_simd);
+#else
 		return x * other.x + y * other.y + z * other.z;
+#endif
 	}
 
 	// Vector cross product
 	Vector3D cross(const Vector3D& other) const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		// (a.yzx * b.zxy) - (a.zxy * b.yzx); the w lanes cancel to zero
+		const __m128 aYZX = _mm_shuffle_ps(m_simd, m_simd, _MM_SHUFFLE(3, 0, 2, 1)),
+			aZXY = _mm_shuffle_ps(m_simd, m_simd, _MM_SHUFFLE(3, 1, 0, 2)),
+			bYZX = _mm_shuffle_ps(other.m_simd, other.m_simd, _MM_SHUFFLE(3, 0, 2, 1)),
+			bZXY = _mm_shuffle_ps(other.m_simd, other.m_simd, _MM_SHUFFLE(3, 1, 0, 2));
+		return Vector3D(_mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)));
+#else
 		Vector3D result;
 		result.x = y * other.z - z * other.y;
 		result.y = z * other.x - x * other.z;
 		result.z = x * other.y - y * other.x;
 		return result;
+#endif
 	}
 
 	// Add a vector to this one
-	Vector3D operator+(const Vector3D& other)
+	Vector3D operator+(const Vector3D& other) const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		return Vector3D(_mm_add_ps(m_simd, other.m_simd));
+#else
 		return Vector3D(x + other.x, y + other.y, z + other.z);
+#endif
 	}
 
 	// subtract a vector from this one
-	Vector3D operator-(const Vector3D& other)
+	Vector3D operator-(const Vector3D& other) const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		return Vector3D(_mm_sub_ps(m_simd, other.m_simd));
+#else
 		return Vector3D(x - other.x, y - other.y, z - other.z);
+#endif
 	}
 
 	// Multiply the vector by a scalar (right-hand)
 	Vector3D operator*(float scalar) const
 	{
+#ifdef RAYCASTER_SIMD_MATH
+		return Vector3D(_mm_mul_ps(m_simd, _mm_set1_ps(scalar)));
+#else
 		return Vector3D(x * scalar, y * scalar, z * scalar);
+#endif
 	}
 
 };
@@ -65,4 +154,3 @@ inline Vector3D operator*(float scalar, const Vector3D& vec)
 {
 	return vec * scalar;
 }
-
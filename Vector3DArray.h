@@ -0,0 +1,27 @@
+#pragma once
+#include "Point3D.h"
+#include "AlignedAllocator.h"
+
+// The x, y and z components of a set of points or vectors, stored as separate aligned arrays
+// (structure of arrays) so that they can be processed four at a time. The arrays are padded to a multiple of four.
+struct Vector3DArray
+{
+	AlignedFloatArray x, y, z;
+	unsigned count = 0;
+
+	// Resizes the arrays to hold n entries, keeping any existing ones
+	void resize(unsigned n)
+	{
+		count = n;
+		const unsigned padded = (n + 3) & ~3u;
+		x.resize(padded, 0.0f);
+		y.resize(padded, 0.0f);
+		z.resize(padded, 0.0f);
+	}
+
+	// Get/set an entry as a point or a vector
+	Point3D		getPoint(unsigned index) const { return Point3D(x[index], y[index], z[index]); }
+	Vector3D	getVector(unsigned index) const { return Vector3D(x[index], y[index], z[index]); }
+	void		setPoint(unsigned index, const Point3D& p) { x[index] = p.x; y[index] = p.y; z[index] = p.z; }
+	void		setVector(unsigned index, const Vector3D& v) { x[index] = v.x; y[index] = v.y; z[index] = v.z; }
+};
@@ -0,0 +1,281 @@
+#include "stdafx.h"
+#include "WavefrontRenderer.h"
+#include "ParallelFor.h"
+#include <chrono>
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Smallest number of queue entries worth handing to a thread
+	const unsigned c_minChunk = 1024;
+
+	// Smallest bounce that is sorted when sorting is switched on (with the O key). With the flat
+	// SceneIntersector every ray tests the same candidates whatever order it comes in, so
+	// "--benchmark raysort" finds sorting slower at any size (0.84-0.86x). It is kept for when
+	// traversal depends on the path a ray takes, e.g. with a hierarchy, and the smallest bounces
+	// are skipped because they can gain the least from it.
+	const unsigned c_minSortedRays = 4096;
+
+	// Flag offset for hits that are shaded without shadows
+	const unsigned c_noOcclusion = 0xFFFFFFFFu;
+
+	// Returns the number of milliseconds since the start time
+	double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+// Renders the frame into the framebuffer. Params are:
+//	frame		the camera's state for this frame
+//	target		the framebuffer, the same size as the pixel buffer (output)
+void WavefrontRenderer::render(const WavefrontFrame& frame, HdrFramebuffer& target)
+{
+	m_stats = WavefrontStats();
+
+	Clock::time_point start = Clock::now();
+	generate(frame, target);
+	m_stats.generateTime = millisecondsSince(start);
+	m_stats.primaryHits = m_hits.count;
+
+	start = Clock::now();
+	traceShadows(frame);
+	m_stats.shadowTime = millisecondsSince(start);
+
+	for (unsigned bounce = 0; m_hits.count > 0; ++bounce)
+	{
+		start = Clock::now();
+		emitReflections(frame, bounce);
+		m_stats.reflectTime += millisecondsSince(start);
+
+		start = Clock::now();
+		shade(frame, target);
+		m_stats.shadeTime += millisecondsSince(start);
+
+		start = Clock::now();
+		intersect(frame);
+		m_stats.intersectTime += millisecondsSince(start);
+	}
+}
+
+// Fills the hit queue with the surface point seen through each pixel, from the pixel buffer,
+// and clears the framebuffer
+void WavefrontRenderer::generate(const WavefrontFrame& frame, HdrFramebuffer& target)
+{
+	const PixelBuffer& pixels = *frame.pixels;
+	const unsigned resolutionX = pixels.width(), lastRow = pixels.height() - 1;
+
+	parallelFor(target.size(), c_minChunk, [&](unsigned begin, unsigned end)
+	{
+		target.clear(begin, end);
+	});
+
+	// Gather the pixels in storage order, so the tiles' lights are read in order
+	m_pixelHits.clear();
+	for (PixelBuffer::Pixel pixel : pixels)
+	{
+		if (pixels.getObjectIndexAt(pixel.index) != PixelBuffer::c_noObject)
+			m_pixelHits.push_back(pixel);
+	}
+
+	m_hits.resize(static_cast<unsigned>(m_pixelHits.size()));
+	parallelFor(m_hits.count, c_minChunk, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned k = begin; k < end; ++k)
+		{
+			const PixelBuffer::Pixel& pixel = m_pixelHits[k];
+			const Object* object = frame.scene->objects[pixels.getObjectIndexAt(pixel.index)];
+			const Vector3D rayDir = frame.rayDirections->getDirection(pixel.i, pixel.j);
+			const Point3D hitPoint = Point3D() + rayDir * pixels.getDepthAt(pixel.index);
+
+			// Without stored normals, find the normal from the object, which is back in world space
+			Vector3D normal = pixels.hasNormals() ? pixels.getNormalAt(pixel.index) :
+				frame.cameraToWorld->inverse() * object->getNormalAt(frame.cameraToWorld->matrix() * hitPoint);
+			if (normal.dot(rayDir) > 0.0f)
+				normal = normal * -1;
+
+			const unsigned tileX = pixel.i >> PixelBuffer::c_tileShift, tileY = pixel.j >> PixelBuffer::c_tileShift;
+			m_hits.imagePixels[k] = pixel.i + resolutionX * (lastRow - pixel.j);
+			m_hits.positions.setPoint(k, hitPoint);
+			m_hits.normals.setVector(k, normal);
+			m_hits.toViewer.setVector(k, rayDir * -1);
+			m_hits.materials[k] = object->m_material;
+			m_hits.weights[k] = 1.0f;
+			m_hits.lights[k] = frame.tileLights->getLights(tileX, tileY);
+			m_hits.numLights[k] = frame.tileLights->getNumLights(tileX, tileY);
+			m_hits.occlusionOffsets[k] = c_noOcclusion;
+		}
+	});
+}
+
+// Queues a shadow ray from each hit towards each of its lights, then traces them. The flags
+// of lights that face away from the surface, or that are looked up in the shadow map, are
+// filled in directly and their rays are skipped.
+void WavefrontRenderer::traceShadows(const WavefrontFrame& frame)
+{
+	if (!frame.shadows)
+		return;
+
+	unsigned total = 0;
+	for (unsigned k = 0; k < m_hits.count; ++k)
+	{
+		m_hits.occlusionOffsets[k] = total;
+		total += m_hits.numLights[k];
+	}
+	m_shadowRays.resize(total);
+
+	const ShadingContext& shading = *frame.shading;
+	const AffineMatrix3D& cameraToWorld = frame.cameraToWorld->matrix();
+	parallelFor(m_hits.count, c_minChunk, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned k = begin; k < end; ++k)
+		{
+			const Vector3D normal = m_hits.normals.getVector(k);
+			const Point3D origin = m_hits.positions.getPoint(k) + normal * c_rayBias;
+			for (unsigned n = 0, entry = m_hits.occlusionOffsets[k]; n < m_hits.numLights[k]; ++n, ++entry)
+			{
+				const unsigned l = m_hits.lights[k][n];
+				Vector3D toLight(shading.x[l], shading.y[l], shading.z[l]);
+				float distance = FLT_MAX;
+				if (shading.isPoint[l])
+				{
+					toLight = toLight - origin.asVector();
+					distance = toLight.magnitude();
+					toLight = toLight * (1.0f / distance);
+				}
+
+				m_shadowRays.occluded[entry] = 1;
+				m_shadowRays.maxDistances[entry] = 0.0f;
+				if (normal.dot(toLight) <= 0.0f)
+					continue;
+
+				if (l == frame.shadowMapLight)
+					m_shadowRays.occluded[entry] = frame.shadowMap->isOccluded(cameraToWorld * origin) ? 1 : 0;
+				else
+				{
+					m_shadowRays.origins.setPoint(entry, origin);
+					m_shadowRays.directions.setVector(entry, toLight);
+					m_shadowRays.maxDistances[entry] = distance;
+				}
+			}
+		}
+	});
+
+	// The objects are in world space, so take the rays there too
+	cameraToWorld.transformPoints(m_shadowRays.origins, m_shadowRays.origins);
+	cameraToWorld.transformVectors(m_shadowRays.directions, m_shadowRays.directions);
+
+	parallelFor(total, c_minChunk, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned r = begin; r < end; ++r)
+		{
+			if (m_shadowRays.maxDistances[r] > 0.0f)
+				m_shadowRays.occluded[r] = frame.intersector->isOccluded(m_shadowRays.origins.getPoint(r), m_shadowRays.directions.getVector(r), m_shadowRays.maxDistances[r]) ? 1 : 0;
+		}
+	});
+
+	for (unsigned r = 0; r < total; ++r)
+		m_stats.shadowRays += m_shadowRays.maxDistances[r] > 0.0f ? 1 : 0;
+}
+
+// Queues the mirror reflection of each hit on a reflective surface, and scales down the hit's
+// own weight to make room for it. This runs on one thread, so the ray budget is used up in
+// the same order on every frame. Params:
+//	frame		the camera's state for this frame
+//	bounce		number of reflections the current hits are from the camera
+void WavefrontRenderer::emitReflections(const WavefrontFrame& frame, unsigned bounce)
+{
+	m_reflectionRays.clear();
+	if (bounce >= frame.maxReflectionDepth)
+		return;
+
+	const MaterialTable& materials = frame.scene->materials;
+	for (unsigned k = 0; k < m_hits.count && m_stats.reflectionRays < frame.secondaryRayBudget; ++k)
+	{
+		const float reflectivity = materials.reflectivity(m_hits.materials[k]);
+		if (reflectivity <= 0.0f)
+			continue;
+
+		const Vector3D normal = m_hits.normals.getVector(k), rayDir = m_hits.toViewer.getVector(k) * -1;
+		const Point3D origin = m_hits.positions.getPoint(k) + normal * c_rayBias;
+		m_reflectionRays.add(origin, rayDir - normal * (2.0f * normal.dot(rayDir)), m_hits.imagePixels[k], m_hits.weights[k] * reflectivity);
+		m_hits.weights[k] *= 1.0f - reflectivity;
+		++m_stats.reflectionRays;
+	}
+
+	const AffineMatrix3D& cameraToWorld = frame.cameraToWorld->matrix();
+	cameraToWorld.transformPoints(m_reflectionRays.origins, m_reflectionRays.origins);
+	cameraToWorld.transformVectors(m_reflectionRays.directions, m_reflectionRays.directions);
+}
+
+// Adds each hit's Phong colour, scaled by its weight, to its pixel. No two hits of the
+// same bounce share a pixel, so the hits can be shaded in any order.
+void WavefrontRenderer::shade(const WavefrontFrame& frame, HdrFramebuffer& target)
+{
+	parallelFor(m_hits.count, c_minChunk, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned k = begin; k < end; ++k)
+		{
+			const unsigned offset = m_hits.occlusionOffsets[k];
+			const unsigned char* occluded = offset == c_noOcclusion ? nullptr : m_shadowRays.occluded.data() + offset;
+			const Vector3D colour = shadePhong(*frame.shading, m_hits.lights[k], m_hits.numLights[k], occluded, frame.scene->materials,
+				m_hits.materials[k], m_hits.positions.getPoint(k), m_hits.normals.getVector(k), m_hits.toViewer.getVector(k));
+
+			target.add(m_hits.imagePixels[k], colour * m_hits.weights[k]);
+		}
+	});
+}
+
+// Traces the reflection rays, and replaces the hit queue with the surfaces they find. Reflected
+// surfaces are lit by every light, without shadows. Sorting the rays only changes the order of
+// the hits, as each still carries its own pixel.
+void WavefrontRenderer::intersect(const WavefrontFrame& frame)
+{
+	SecondaryRays& rays = m_reflectionRays;
+	if (frame.sortSecondaryRays && rays.count >= c_minSortedRays)
+		m_raySorter.sort(rays);
+
+	parallelFor(rays.count, c_minChunk / 4, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned r = begin; r < end; ++r)
+		{
+			if (!frame.intersector->findClosestHit(rays.origins.getPoint(r), rays.directions.getVector(r), FLT_MAX, rays.hitDistances[r], rays.hitObjects[r]))
+				rays.hitObjects[r] = SecondaryRays::c_noHit;
+		}
+	});
+
+	m_rayHits.clear();
+	for (unsigned r = 0; r < rays.count; ++r)
+	{
+		if (rays.hitObjects[r] != SecondaryRays::c_noHit)
+			m_rayHits.push_back(r);
+	}
+
+	const AffineMatrix3D& worldToCamera = frame.cameraToWorld->inverse();
+	m_hits.resize(static_cast<unsigned>(m_rayHits.size()));
+	parallelFor(m_hits.count, c_minChunk, [&](unsigned begin, unsigned end)
+	{
+		for (unsigned k = begin; k < end; ++k)
+		{
+			const unsigned r = m_rayHits[k];
+			const Object* object = frame.scene->objects[rays.hitObjects[r]];
+			const Vector3D rayDir = rays.directions.getVector(r);
+			const Point3D hitPoint = rays.origins.getPoint(r) + rayDir * rays.hitDistances[r];
+			Vector3D normal = object->getNormalAt(hitPoint);
+			if (normal.dot(rayDir) > 0.0f)
+				normal = normal * -1;
+
+			m_hits.imagePixels[k] = rays.pixels[r];
+			m_hits.positions.setPoint(k, worldToCamera * hitPoint);
+			m_hits.normals.setVector(k, worldToCamera * normal);
+			m_hits.toViewer.setVector(k, worldToCamera * (rayDir * -1));
+			m_hits.materials[k] = object->m_material;
+			m_hits.weights[k] = rays.weights[r];
+			m_hits.lights[k] = frame.allLights;
+			m_hits.numLights[k] = frame.shading->numLights;
+			m_hits.occlusionOffsets[k] = c_noOcclusion;
+		}
+	});
+}
+
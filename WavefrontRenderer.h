@@ -0,0 +1,108 @@
+#pragma once
+#include "PixelBuffer.h"
+#include "RayDirectionTable.h"
+#include "Shading.h"
+#include "LightCulling.h"
+#include "SceneIntersector.h"
+#include "ShadowMap.h"
+#include "Scene.h"
+#include "HdrFramebuffer.h"
+#include "RaySorter.h"
+#include <vector>
+
+// Surface points waiting to be shaded, with each property in its own array. Positions,
+// normals and directions are in camera space, where shading is done.
+struct HitQueue
+{
+	std::vector<unsigned>			imagePixels;	// Index of the pixel the hit contributes to, in the linear image
+	Vector3DArray					positions;
+	Vector3DArray					normals;		// Unit length, facing the viewer
+	Vector3DArray					toViewer;		// Unit direction back along the ray
+	std::vector<unsigned>			materials;
+	std::vector<float>				weights;		// Fraction of the pixel's colour the hit provides
+	std::vector<const unsigned*>	lights;			// The lights to shade the hit with
+	std::vector<unsigned>			numLights;
+	std::vector<unsigned>			occlusionOffsets;	// Index of the hit's first light in the shadow flags
+	unsigned						count = 0;
+
+	// Sets the number of hits, growing the arrays if needed, so they can be filled in any order
+	void resize(unsigned n)
+	{
+		if (n > imagePixels.size())
+		{
+			imagePixels.resize(n);
+			positions.resize(n);
+			normals.resize(n);
+			toViewer.resize(n);
+			materials.resize(n);
+			weights.resize(n);
+			lights.resize(n);
+			numLights.resize(n);
+			occlusionOffsets.resize(n);
+		}
+		count = n;
+	}
+};
+
+// The camera's per-frame state that the wavefront renderer reads from
+struct WavefrontFrame
+{
+	const Scene*				scene = nullptr;				// Objects (in world space), materials and lights
+	const PixelBuffer*			pixels = nullptr;				// Closest object to each pixel
+	const RayDirectionTable*	rayDirections = nullptr;		// Camera space direction through each pixel
+	const ShadingContext*		shading = nullptr;				// The lights, in camera space
+	const TileLightLists*		tileLights = nullptr;			// The lights that reach each tile
+	const unsigned*				allLights = nullptr;			// Every light index, for reflected hits
+	const SceneIntersector*		intersector = nullptr;			// Built for this frame if shadows or reflections are on
+	const AffineTransform*		cameraToWorld = nullptr;
+	bool						shadows = false;
+	const ShadowMap*			shadowMap = nullptr;			// Used for shadowMapLight instead of rays
+	unsigned					shadowMapLight = 0xFFFFFFFFu;
+	unsigned					maxReflectionDepth = 0;
+	unsigned					secondaryRayBudget = 0;
+	bool						sortSecondaryRays = false;		// Sort each bounce's reflection rays before tracing them
+};
+
+// Time taken by each stage on the last frame (in milliseconds), and the size of its queues
+struct WavefrontStats
+{
+	double		generateTime = 0.0, shadowTime = 0.0, reflectTime = 0.0, shadeTime = 0.0, intersectTime = 0.0;
+	unsigned	primaryHits = 0, shadowRays = 0, reflectionRays = 0;
+
+	double totalTime() const { return generateTime + shadowTime + reflectTime + shadeTime + intersectTime; }
+};
+
+// Renders the image as a series of separate stages instead of shading each tile to completion.
+// Each stage reads one flat queue and writes the next, and runs as a parallel loop over its queue:
+//	generate	gathers the surface point seen through each pixel into the hit queue
+//	shadow		queues a shadow ray per hit and light, and traces them
+//	reflect		queues a reflection ray for each hit on a reflective surface, within the ray budget
+//	shade		adds each hit's Phong colour to its pixel
+//	intersect	traces the reflection rays (sorted first, if enabled), making the next hit queue
+// Shade, reflect and intersect repeat for each bounce. Hits are shaded exactly as in Camera's
+// tiled path, with normals facing the viewer, so the images match while the secondary ray budget
+// lasts. Once it runs out they differ, as the budget is spent bounce by bounce across the whole
+// frame here, rather than in equal shares per tile.
+// The colours are added up in the camera's floating point framebuffer, which it tone maps afterwards.
+class WavefrontRenderer
+{
+public:
+	void render(const WavefrontFrame& frame, HdrFramebuffer& target);
+
+	const WavefrontStats& getStats() const { return m_stats; }
+
+private:
+	void generate(const WavefrontFrame& frame, HdrFramebuffer& target);
+	void traceShadows(const WavefrontFrame& frame);
+	void emitReflections(const WavefrontFrame& frame, unsigned depth);
+	void shade(const WavefrontFrame& frame, HdrFramebuffer& target);
+	void intersect(const WavefrontFrame& frame);
+
+	HitQueue					m_hits;				// Hits of the current bounce
+	OcclusionRays				m_shadowRays;		// Shadow rays of the current bounce; their occluded flags are read by the shade stage
+	SecondaryRays				m_reflectionRays;	// Reflection rays spawned by the current bounce, in image order until sorted
+	RaySorter					m_raySorter;
+	std::vector<PixelBuffer::Pixel>	m_pixelHits;	// Every pixel that sees an object
+	std::vector<unsigned>		m_rayHits;			// Index of every reflection ray that hit something
+	WavefrontStats				m_stats;
+};
@@ -20,5 +20,6 @@
 
 // reference additional headers your program requires here
 #include <iostream>
+#include <string>
 #include <vector>
 #include <SDL.h>
\ No newline at end of file